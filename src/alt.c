@@ -0,0 +1,277 @@
+/* ALT Landmarks for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alt.h"
+#include "kheap.h"
+
+#define ALT_SEED 2463534242u // xorshift32 state of ALT_RANDOM picks
+
+// One direction of the graph in CSR layout
+typedef struct {
+    uint32_t n_vert;        // number of vertices with an entry in off
+    const uint32_t *off;
+    const uint16_t *adj;    // dest of the outbound (or src of the inbound)
+    const uint16_t *cost;   // edges of each vertex
+} csr_t;
+
+/* One-to-all Dijkstra from src
+ *
+ * Guarantees:
+ *   - dist[v*stride] is the distance from src to each of the n vertices;
+ *     ALT_NONE if v is unreached. Distances of 16-bit costs over simple
+ *     paths stay below ALT_NONE
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+static int alt_search( kheap_t *h
+                     , const csr_t *g
+                     , uint32_t n
+                     , uint16_t src
+                     , uint32_t *dist
+                     , uint32_t stride
+                     )
+{
+    uint32_t i = 0, k = 0;
+
+    for(i = 0; i < n; ++i) dist[(size_t)i * stride] = ALT_NONE;
+    dist[(size_t)src * stride] = 0;
+    h->n = 0;
+    if(0 != kheap_push(h, src)) return -1;
+    while(h->n > 0) {
+        uint64_t top = kheap_pop(h);
+        uint16_t s = top & 0xffff;
+        uint32_t d = top >> 16;
+        if(d != dist[(size_t)s * stride] || s >= g->n_vert) continue; // stale
+        for(k = g->off[s]; k < g->off[s+1]; ++k) {
+            uint32_t *x = &dist[(size_t)g->adj[k] * stride];
+            uint32_t nd = d + g->cost[k];
+            if(nd < *x) {
+                *x = nd;
+                if(0 != kheap_push(h, (uint64_t)nd << 16 | g->adj[k])) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if vertex i has an outbound or inbound edge
+static int alt_has_edges( const csr_t *fwd
+                        , const csr_t *bwd
+                        , uint32_t i
+                        )
+{
+    return (i < fwd->n_vert && fwd->off[i+1] > fwd->off[i])
+        || (i < bwd->n_vert && bwd->off[i+1] > bwd->off[i]);
+}
+
+// Returns d(L, v) + d(v, L) of landmark slot j, counting a missing half as
+// 0; none if v is disconnected from L both ways
+static uint64_t alt_spread( const alt_t *alt
+                          , uint32_t v
+                          , uint32_t j
+                          , uint64_t none
+                          )
+{
+    uint32_t f = alt->from[(size_t)v * alt->k + j];
+    uint32_t t = alt->to[(size_t)v * alt->k + j];
+
+    if(ALT_NONE == f && ALT_NONE == t) return none;
+    return (uint64_t)(ALT_NONE == f ? 0 : f) + (ALT_NONE == t ? 0 : t);
+}
+
+// Fills landmark slot j with the distances from and to l
+static int alt_column( alt_t *alt
+                     , kheap_t *h
+                     , const csr_t *fwd
+                     , const csr_t *bwd
+                     , uint32_t j
+                     , uint16_t l
+                     )
+{
+    if(0 != alt_search(h, fwd, alt->n_vert, l, alt->from + j, alt->k)) return -1;
+    return alt_search(h, bwd, alt->n_vert, l, alt->to + j, alt->k);
+}
+
+// Allocates the landmark and distance arrays of k landmarks over n vertices
+static int alt_alloc( alt_t *alt
+                    , uint32_t n
+                    , uint32_t k
+                    )
+{
+    char *mem = malloc(sizeof(*alt->from) * 2 * (size_t)n * k
+                     + sizeof(*alt->lm) * k);
+
+    if(!mem) return -1;
+    alt->from = (uint32_t *)mem;
+    alt->to = alt->from + (size_t)n * k;
+    alt->lm = (uint16_t *)(alt->to + (size_t)n * k);
+    alt->k = k;
+    alt->n_vert = n;
+    return 0;
+}
+
+int alt_build( alt_t *alt
+             , uint32_t n_vert
+             , const uint32_t *off
+             , const uint16_t *dest
+             , const uint16_t *cost
+             , uint32_t rn_vert
+             , const uint32_t *roff
+             , const uint16_t *rsrc
+             , const uint16_t *rcost
+             , uint32_t k
+             , int select
+             )
+{
+    int rc = -1;
+    kheap_t h = {0};
+    csr_t fwd = { n_vert, off, dest, cost }, bwd = { rn_vert, roff, rsrc, rcost };
+    uint32_t n = n_vert > rn_vert ? n_vert : rn_vert;
+    uint32_t i = 0, j = 0, n_cand = 0, rng = ALT_SEED;
+    uint64_t *score = NULL; // ALT_FARTHEST: the least spread of each vertex
+    char *picked = NULL;
+
+    memset(alt, 0, sizeof(*alt));
+    for(i = 0; i < n; ++i) n_cand += alt_has_edges(&fwd, &bwd, i);
+    if(k > n_cand) k = n_cand;
+    if(0 == k) return 0;
+    score = malloc(sizeof(*score) * n);
+    picked = calloc(n, sizeof(*picked));
+    if(!score || !picked || 0 != alt_alloc(alt, n, k)) goto cleanup;
+
+    for(j = 0; j < k; ++j) {
+        uint64_t best = 0;
+        uint16_t l = 0;
+        int found = 0;
+        if(ALT_RANDOM == select) {
+            do {
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+                l = rng % n;
+            } while(picked[l] || !alt_has_edges(&fwd, &bwd, l));
+        } else {
+            if(0 == j) { // the vertex farthest from the first with edges
+                for(i = 0; !alt_has_edges(&fwd, &bwd, i); ++i);
+                if(0 != alt_column(alt, &h, &fwd, &bwd, 0, i)) goto cleanup;
+                for(i = 0; i < n; ++i) score[i] = alt_spread(alt, i, 0, 0);
+            }
+            for(i = 0, found = 0; i < n; ++i) { // the least covered
+                if(picked[i] || !alt_has_edges(&fwd, &bwd, i)) continue;
+                if(!found || score[i] > best) {
+                    found = 1;
+                    best = score[i];
+                    l = i;
+                }
+            }
+        }
+        picked[l] = 1;
+        alt->lm[j] = l;
+        if(0 != alt_column(alt, &h, &fwd, &bwd, j, l)) goto cleanup;
+        for(i = 0; ALT_FARTHEST == select && i < n; ++i) {
+            uint64_t s = alt_spread(alt, i, j, UINT64_MAX);
+            if(0 == j || s < score[i]) score[i] = s;
+        }
+    }
+    rc = 0;
+cleanup:
+    if(0 != rc) alt_free(alt);
+    free(score);
+    free(picked);
+    free(h.k);
+    return rc;
+}
+
+int alt_update( alt_t *alt
+              , const alt_t *prev
+              , uint32_t n_vert
+              , const uint32_t *off
+              , const uint16_t *dest
+              , const uint16_t *cost
+              , uint32_t rn_vert
+              , const uint32_t *roff
+              , const uint16_t *rsrc
+              , const uint16_t *rcost
+              )
+{
+    int rc = -1;
+    kheap_t h = {0};
+    csr_t fwd = { n_vert, off, dest, cost }, bwd = { rn_vert, roff, rsrc, rcost };
+    uint32_t n = n_vert > rn_vert ? n_vert : rn_vert, j = 0;
+
+    memset(alt, 0, sizeof(*alt));
+    if(0 == prev->k) return 0;
+    if(n < prev->n_vert) n = prev->n_vert;
+    if(0 != alt_alloc(alt, n, prev->k)) return -1;
+    memcpy(alt->lm, prev->lm, sizeof(*alt->lm) * prev->k);
+    for(j = 0; j < alt->k; ++j) {
+        if(0 != alt_column(alt, &h, &fwd, &bwd, j, alt->lm[j])) goto cleanup;
+    }
+    rc = 0;
+cleanup:
+    if(0 != rc) alt_free(alt);
+    free(h.k);
+    return rc;
+}
+
+uint32_t alt_bound( const alt_t *alt
+                  , uint16_t v
+                  , uint16_t t
+                  )
+{
+    const uint32_t *fv = NULL, *ft = NULL, *tv = NULL, *tt = NULL;
+    uint32_t b = 0, i = 0;
+
+    if(v >= alt->n_vert || t >= alt->n_vert) return 0;
+    fv = alt->from + (size_t)v * alt->k;
+    ft = alt->from + (size_t)t * alt->k;
+    tv = alt->to + (size_t)v * alt->k;
+    tt = alt->to + (size_t)t * alt->k;
+    for(i = 0; i < alt->k; ++i) {
+        // d(L, t) - d(L, v): L reaching v but not t means v can't reach t
+        if(ALT_NONE == ft[i]) {
+            if(ALT_NONE != fv[i]) return ALT_NONE;
+        }
+        else if(ALT_NONE != fv[i] && ft[i] > fv[i] && ft[i] - fv[i] > b) {
+            b = ft[i] - fv[i];
+        }
+        // d(v, L) - d(t, L): t reaching L but not v means v can't reach t
+        if(ALT_NONE == tv[i]) {
+            if(ALT_NONE != tt[i]) return ALT_NONE;
+        }
+        else if(ALT_NONE != tt[i] && tv[i] > tt[i] && tv[i] - tt[i] > b) {
+            b = tv[i] - tt[i];
+        }
+    }
+    return b;
+}
+
+void alt_free(alt_t *alt)
+{
+    free(alt->from);
+    memset(alt, 0, sizeof(*alt));
+}
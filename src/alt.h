@@ -0,0 +1,129 @@
+/* ALT Landmarks for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef ALT_H
+#define ALT_H
+
+#include <stdint.h>
+
+/* ALT (A*, landmarks & the triangle inequality) lower bounds. For every
+ * landmark L the distances d(L, v) and d(v, L) of each vertex are stored;
+ * then for any v and t
+ *
+ *   d(v, t) >= d(L, t) - d(L, v)  and  d(v, t) >= d(v, L) - d(t, L)
+ *
+ * and the largest of these bounds over the landmarks is a consistent A*
+ * potential toward t. The distances of vertex v are from[v*k] ..
+ * from[v*k+k-1] (to is laid out the same), so a bound reads 2 runs of k.
+ */
+#define ALT_NONE UINT32_MAX // distance of a vertex the landmark can't reach
+                            // (or be reached from)
+#define ALT_K_MAX 64        // landmarks a graph may have
+
+// How landmarks are picked
+enum {
+    ALT_FARTHEST = 0, // each one farthest (to and from) from those before
+    ALT_RANDOM = 1    // uniformly among the vertices with edges
+};
+
+typedef struct {
+    uint32_t k;       // number of landmarks; 0 if there are none
+    uint32_t n_vert;  // vertices with distances (1 + largest id with edges)
+    uint16_t *lm;     // the landmark vertices
+    uint32_t *from;   // n_vert*k distances from each landmark; owns the
+                      // allocation
+    uint32_t *to;     // n_vert*k distances to each landmark
+} alt_t;
+
+/* Pick the landmarks of a CSR graph and store their distances
+ *
+ * Requires:
+ *   - The CSR arrays of a graph and of its reverse adjacency (see graph_t
+ *     in main.c); vertex ids < 65536
+ *   - A reference to an alt_t to fill in
+ *   - The number of landmarks, 1 .. ALT_K_MAX, and how they are picked
+ *     (ALT_*)
+ *
+ * Guarantees:
+ *   - Landmarks are distinct vertices with edges; fewer than k are picked
+ *     if the graph doesn't have that many
+ *   - Each landmark costs a forward and a backward one-to-all search
+ *   - The picks are deterministic for a given graph
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int alt_build( alt_t *alt
+             , uint32_t n_vert
+             , const uint32_t *off
+             , const uint16_t *dest
+             , const uint16_t *cost
+             , uint32_t rn_vert
+             , const uint32_t *roff
+             , const uint16_t *rsrc
+             , const uint16_t *rcost
+             , uint32_t k
+             , int select
+             );
+
+/* Recompute the distances of the landmarks of prev on an updated graph
+ *
+ * Requires:
+ *   - The CSR arrays of the updated graph, as for alt_build(); it has
+ *     every vertex of the graph prev was built for
+ *   - A reference to an alt_t to fill in; prev is left untouched
+ *
+ * Guarantees:
+ *   - The landmarks of prev are kept, so only their searches are redone
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int alt_update( alt_t *alt
+              , const alt_t *prev
+              , uint32_t n_vert
+              , const uint32_t *off
+              , const uint16_t *dest
+              , const uint16_t *cost
+              , uint32_t rn_vert
+              , const uint32_t *roff
+              , const uint16_t *rsrc
+              , const uint16_t *rcost
+              );
+
+/* Returns the ALT lower bound of the distance from v to t
+ *
+ * Guarantees:
+ *   - 0 if either vertex has no distances
+ *   - ALT_NONE if some landmark proves t can't be reached from v
+ *   - The bound is consistent: it is 0 at t and drops by at most the cost
+ *     of an edge from v to any vertex that isn't ALT_NONE
+ */
+uint32_t alt_bound( const alt_t *alt
+                  , uint16_t v
+                  , uint16_t t
+                  );
+
+// Releases landmarks picked by alt_build()
+void alt_free(alt_t *alt);
+
+#endif // ALT_H
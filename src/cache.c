@@ -0,0 +1,284 @@
+/* Reply Cache for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+#define CACHE_BUCKETS_MIN 256 // initial hash buckets of a shard
+
+typedef struct ent {
+    cache_key_t k;
+    struct ent *chain;  // next entry of the same bucket
+    struct ent *newer;  // LRU list; the head is the most recently used
+    struct ent *older;
+    size_t len;
+    char val[];
+} ent_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ent_t **bucket;     // n_bucket chains; n_bucket is a power of 2
+    uint32_t n_bucket;
+    ent_t *newest;
+    ent_t *oldest;
+    size_t bytes;
+    size_t cap;         // bytes the shard may hold
+    cache_stats_t st;
+} shard_t;
+
+static shard_t shards[CACHE_SHARDS];
+static int enabled = 0;
+
+int cache_init(size_t bytes)
+{
+    uint32_t i = 0;
+
+    if(0 == bytes) return 0;
+    for(i = 0; i < CACHE_SHARDS; ++i) {
+        shard_t *s = &shards[i];
+        memset(s, 0, sizeof(*s));
+        pthread_mutex_init(&s->lock, NULL);
+        s->bucket = calloc(CACHE_BUCKETS_MIN, sizeof(*s->bucket));
+        if(!s->bucket) return -1;
+        s->n_bucket = CACHE_BUCKETS_MIN;
+        s->cap = bytes / CACHE_SHARDS;
+    }
+    enabled = 1;
+    return 0;
+}
+
+int cache_enabled(void)
+{
+    return enabled;
+}
+
+// Mixes 64 bits into a lane of the hash
+static inline uint64_t mix( uint64_t h
+                          , uint64_t x
+                          )
+{
+    h ^= x * 0x9e3779b97f4a7c15ull;
+    h = (h << 31) | (h >> 33);
+    return h * 0xff51afd7ed558ccdull;
+}
+
+void cache_key( cache_key_t *k
+              , const void *p
+              , size_t len
+              , uint64_t salt
+              )
+{
+    const char *c = p;
+    uint64_t a = 0x243f6a8885a308d3ull ^ salt, b = 0x13198a2e03707344ull + len;
+    uint64_t x = 0;
+    size_t i = 0;
+
+    for(; i + 8 <= len; i += 8) { // two lanes, 8 bytes at a time
+        memcpy(&x, c + i, sizeof(x));
+        a = mix(a, x);
+        b = mix(b, x ^ a);
+    }
+    x = 0;
+    memcpy(&x, c + i, len - i);
+    a = mix(a, x ^ len);
+    b = mix(b, x ^ salt);
+    a ^= a >> 29; // finalize: every input bit reaches every output bit
+    b ^= a;
+    b ^= b >> 32;
+    k->h[0] = mix(a, b);
+    k->h[1] = mix(b, k->h[0]);
+}
+
+static inline shard_t * shard_of(const cache_key_t *k)
+{
+    return &shards[k->h[1] % CACHE_SHARDS];
+}
+
+// Returns the entry of k in s, or NULL; lock held
+static ent_t * find( shard_t *s
+                   , const cache_key_t *k
+                   )
+{
+    ent_t *e = s->bucket[k->h[0] & (s->n_bucket - 1)];
+
+    while(e && (e->k.h[0] != k->h[0] || e->k.h[1] != k->h[1])) e = e->chain;
+    return e;
+}
+
+// Unlinks e from the LRU list of s; lock held
+static void lru_unlink( shard_t *s
+                      , ent_t *e
+                      )
+{
+    if(e->newer) e->newer->older = e->older;
+    else s->newest = e->older;
+    if(e->older) e->older->newer = e->newer;
+    else s->oldest = e->newer;
+}
+
+// Makes e the most recently used entry of s; lock held
+static void lru_push( shard_t *s
+                    , ent_t *e
+                    )
+{
+    e->newer = NULL;
+    e->older = s->newest;
+    if(s->newest) s->newest->newer = e;
+    else s->oldest = e;
+    s->newest = e;
+}
+
+// Removes e from s and frees it; lock held
+static void drop( shard_t *s
+                , ent_t *e
+                )
+{
+    ent_t **pp = &s->bucket[e->k.h[0] & (s->n_bucket - 1)];
+
+    while(*pp != e) pp = &(*pp)->chain;
+    *pp = e->chain;
+    lru_unlink(s, e);
+    s->bytes -= sizeof(*e) + e->len;
+    --s->st.entries;
+    free(e);
+}
+
+// Doubles the buckets of s once it has 2 entries per bucket; lock held
+static void grow(shard_t *s)
+{
+    uint32_t i = 0, n = s->n_bucket * 2;
+    ent_t **b = NULL;
+
+    if(s->st.entries < 2 * (uint64_t)s->n_bucket) return;
+    if(!(b = calloc(n, sizeof(*b)))) return; // chains just get longer
+    for(i = 0; i < s->n_bucket; ++i) {
+        ent_t *e = s->bucket[i], *next = NULL;
+        for(; e; e = next) {
+            next = e->chain;
+            e->chain = b[e->k.h[0] & (n - 1)];
+            b[e->k.h[0] & (n - 1)] = e;
+        }
+    }
+    free(s->bucket);
+    s->bucket = b;
+    s->n_bucket = n;
+}
+
+// Looks k up for cache_get() and cache_probe(); count adds the hit or miss
+static long lookup( const cache_key_t *k
+                  , char **buf
+                  , size_t *cap
+                  , int count
+                  )
+{
+    shard_t *s = shard_of(k);
+    ent_t *e = NULL;
+    long len = -1;
+
+    if(!enabled) return -1;
+    pthread_mutex_lock(&s->lock);
+    if((e = find(s, k)) && e->len + 1 > *cap) {
+        char *p = realloc(*buf, e->len + 1);
+        if(p) {
+            *buf = p;
+            *cap = e->len + 1;
+        }
+    }
+    if(e && e->len + 1 <= *cap) {
+        memcpy(*buf, e->val, e->len);
+        (*buf)[e->len] = '\0'; // text replies may be sent NUL-terminated
+        len = e->len;
+        lru_unlink(s, e);
+        lru_push(s, e);
+        s->st.hits += count;
+    }
+    else s->st.misses += count;
+    pthread_mutex_unlock(&s->lock);
+    return len;
+}
+
+long cache_get( const cache_key_t *k
+              , char **buf
+              , size_t *cap
+              )
+{
+    return lookup(k, buf, cap, 1);
+}
+
+long cache_probe( const cache_key_t *k
+                , char **buf
+                , size_t *cap
+                )
+{
+    return lookup(k, buf, cap, 0);
+}
+
+void cache_put( const cache_key_t *k
+              , const void *val
+              , size_t len
+              )
+{
+    shard_t *s = shard_of(k);
+    ent_t *e = NULL, *old = NULL;
+    size_t sz = sizeof(*e) + len;
+
+    if(!enabled || sz > s->cap / 4) return;
+    if(!(e = malloc(sz))) return;
+    e->k = *k;
+    e->len = len;
+    memcpy(e->val, val, len);
+    pthread_mutex_lock(&s->lock);
+    if((old = find(s, k))) drop(s, old);
+    while(s->oldest && s->bytes + sz > s->cap) {
+        drop(s, s->oldest);
+        ++s->st.evictions;
+    }
+    e->chain = s->bucket[k->h[0] & (s->n_bucket - 1)];
+    s->bucket[k->h[0] & (s->n_bucket - 1)] = e;
+    lru_push(s, e);
+    s->bytes += sz;
+    ++s->st.entries;
+    grow(s);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void cache_stats(cache_stats_t *st)
+{
+    uint32_t i = 0;
+
+    memset(st, 0, sizeof(*st));
+    if(!enabled) return;
+    for(i = 0; i < CACHE_SHARDS; ++i) {
+        shard_t *s = &shards[i];
+        pthread_mutex_lock(&s->lock);
+        st->hits += s->st.hits;
+        st->misses += s->st.misses;
+        st->evictions += s->st.evictions;
+        st->entries += s->st.entries;
+        st->bytes += s->bytes;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,108 @@
+/* Reply Cache for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A bounded LRU cache of replies, split into CACHE_SHARDS shards with a
+ * lock each so workers rarely contend. Keys are 128-bit hashes of the bytes
+ * a reply depends on; values are copied in and out, so an entry can be
+ * evicted while its copy is being sent
+ */
+#define CACHE_SHARDS 16
+
+typedef struct {
+    uint64_t h[2];
+} cache_key_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t bytes;     // bytes of the entries, their headers included
+} cache_stats_t;
+
+/* Size the cache
+ *
+ * Requires:
+ *   - The bytes the cache may hold; 0 disables it
+ *   - No other cache call is in progress
+ *
+ * Guarantees:
+ *   - Each shard holds up to 1/CACHE_SHARDS of the bytes; a value larger
+ *     than a quarter of a shard is never cached
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int cache_init(size_t bytes);
+
+// Returns 1 if the cache was sized by cache_init() and 0 if it is disabled
+int cache_enabled(void);
+
+// Hashes len bytes into k; salt tells apart replies to the same bytes
+void cache_key( cache_key_t *k
+              , const void *p
+              , size_t len
+              , uint64_t salt
+              );
+
+/* Look a reply up
+ *
+ * Requires:
+ *   - A key from cache_key()
+ *   - A malloc'd buffer and its capacity, grown with realloc if needed
+ *
+ * Guarantees:
+ *   - On a hit the reply is copied into the buffer and becomes the most
+ *     recently used entry of its shard
+ *   - The hit or miss is counted
+ *   - The length of the reply will be returned on a hit
+ *   - -1 will be returned on a miss (or if the buffer can't grow)
+ */
+long cache_get( const cache_key_t *k
+              , char **buf
+              , size_t *cap
+              );
+
+// Looks a reply up like cache_get() without counting the hit or miss, for
+// lookups made on behalf of another message (see tree_path)
+long cache_probe( const cache_key_t *k
+                , char **buf
+                , size_t *cap
+                );
+
+// Stores a copy of a reply under k, replacing any entry of k and evicting the
+// least recently used entries of its shard to make room
+void cache_put( const cache_key_t *k
+              , const void *val
+              , size_t len
+              );
+
+// Adds up the counters of every shard
+void cache_stats(cache_stats_t *s);
+
+#endif // CACHE_H
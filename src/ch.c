@@ -0,0 +1,336 @@
+/* Contraction Hierarchies for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "kheap.h"
+
+#define CH_SETTLE_MAX 256 // vertices a witness search may settle
+#define CH_PRIO_BIAS (1LL << 40) // keeps negative priorities sortable
+
+// Growable list of the arcs of one vertex while contracting
+typedef struct {
+    ch_arc_t *a;
+    uint32_t n;
+    uint32_t cap;
+} arcs_t;
+
+// Contraction state. A contracted vertex keeps its arcs; they are skipped
+// by everything after it is done and become its up/dn arcs at the end
+typedef struct {
+    uint32_t n_vert;
+    arcs_t *out;        // outbound arcs of each vertex
+    arcs_t *in;         // inbound arcs of each vertex (to is the source)
+    char *done;         // vertex has been contracted
+    uint32_t *deleted;  // contracted neighbours of each vertex
+    uint32_t *rank;
+    uint64_t *dist;     // witness search distance; valid if stamp == epoch
+    uint32_t *stamp;
+    uint32_t epoch;
+    kheap_t h;          // witness search queue
+} ctx_t;
+
+// Appends an arc to a list, growing it as needed; returns 0 or -1
+static int arcs_add( arcs_t *l
+                   , uint16_t to
+                   , uint16_t mid
+                   , uint32_t cost
+                   )
+{
+    if(l->n == l->cap) {
+        uint32_t cap = l->cap ? l->cap * 2 : 4;
+        ch_arc_t *p = realloc(l->a, sizeof(*p) * cap);
+        if(!p) return -1;
+        l->a = p;
+        l->cap = cap;
+    }
+    l->a[l->n].to = to;
+    l->a[l->n].mid = mid;
+    l->a[l->n].cost = cost;
+    ++l->n;
+    return 0;
+}
+
+/* Add the arc u->w or lower its cost if it's already there
+ *
+ * Guarantees:
+ *   - There is at most one arc per (u, w) pair; out[u] and in[w] agree
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+static int arc_link( ctx_t *c
+                   , uint16_t u
+                   , uint16_t w
+                   , uint32_t cost
+                   , uint16_t mid
+                   )
+{
+    arcs_t *out = &c->out[u], *in = &c->in[w];
+    uint32_t k = 0;
+
+    for(k = 0; k < out->n; ++k) {
+        if(out->a[k].to != w) continue;
+        if(cost >= out->a[k].cost) return 0;
+        out->a[k].cost = cost;
+        out->a[k].mid = mid;
+        for(k = 0; k < in->n; ++k) {
+            if(in->a[k].to != u) continue;
+            in->a[k].cost = cost;
+            in->a[k].mid = mid;
+        }
+        return 0;
+    }
+    if(0 != arcs_add(out, w, mid, cost)) return -1;
+    return arcs_add(in, u, mid, cost);
+}
+
+/* Search for witnesses: paths from u that avoid the vertex being contracted
+ *
+ * Guarantees:
+ *   - Vertices within max_d of u (not through skip or contracted vertices)
+ *     have their distance stamped with the current epoch, as far as the
+ *     search gets within CH_SETTLE_MAX settled vertices
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+static int witness( ctx_t *c
+                  , uint16_t u
+                  , uint16_t skip
+                  , uint64_t max_d
+                  )
+{
+    uint32_t settled = 0, k = 0;
+
+    if(0 == ++c->epoch) { // wrapped; stale stamps could now look current
+        memset(c->stamp, 0, sizeof(*c->stamp) * c->n_vert);
+        c->epoch = 1;
+    }
+    c->h.n = 0;
+    c->stamp[u] = c->epoch;
+    c->dist[u] = 0;
+    if(0 != kheap_push(&c->h, u)) return -1;
+    while(c->h.n > 0) {
+        uint64_t key = kheap_pop(&c->h), d = key >> 16;
+        uint16_t x = key & 0xffff;
+        arcs_t *out = &c->out[x];
+        if(d > c->dist[x]) continue; // stale
+        if(d > max_d || ++settled > CH_SETTLE_MAX) break;
+        for(k = 0; k < out->n; ++k) {
+            uint16_t y = out->a[k].to;
+            uint64_t nd = d + out->a[k].cost;
+            if(c->done[y] || y == skip || nd > max_d) continue;
+            if(c->stamp[y] != c->epoch || nd < c->dist[y]) {
+                c->stamp[y] = c->epoch;
+                c->dist[y] = nd;
+                if(0 != kheap_push(&c->h, nd << 16 | y)) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Contract a vertex, or only count the shortcuts contracting it would add
+ *
+ * Guarantees:
+ *   - For each live in-neighbour u and out-neighbour w of v, the shortcut
+ *     u->w (through v) is added unless a witness is at least as short
+ *   - Nothing is modified if sim is set
+ *   - The number of shortcuts will be returned on success
+ *   - -1 will be returned on error
+ */
+static int64_t contract( ctx_t *c
+                       , uint16_t v
+                       , int sim
+                       )
+{
+    arcs_t *in = &c->in[v], *out = &c->out[v];
+    uint64_t max_out = 0;
+    int64_t n = 0;
+    uint32_t i = 0, k = 0;
+
+    for(k = 0; k < out->n; ++k) {
+        if(!c->done[out->a[k].to] && out->a[k].cost > max_out) {
+            max_out = out->a[k].cost;
+        }
+    }
+    for(i = 0; i < in->n; ++i) {
+        uint16_t u = in->a[i].to;
+        uint64_t c1 = in->a[i].cost;
+        if(c->done[u]) continue;
+        if(0 != witness(c, u, v, c1 + max_out)) return -1;
+        for(k = 0; k < out->n; ++k) {
+            uint16_t w = out->a[k].to;
+            uint64_t via = c1 + out->a[k].cost;
+            if(c->done[w] || w == u) continue;
+            if(c->stamp[w] == c->epoch && c->dist[w] <= via) continue;
+            if(via > UINT32_MAX) continue; // not simple, so never shortest
+            ++n;
+            if(!sim && 0 != arc_link(c, u, w, via, v)) return -1;
+        }
+    }
+    return n;
+}
+
+// Returns the ordering key of v (lower contracts first) or -1 on error
+static int64_t priority( ctx_t *c
+                       , uint16_t v
+                       )
+{
+    int64_t n = contract(c, v, 1);
+    uint32_t k = 0;
+
+    if(n < 0) return -1;
+    for(k = 0; k < c->in[v].n; ++k) n -= !c->done[c->in[v].a[k].to];
+    for(k = 0; k < c->out[v].n; ++k) n -= !c->done[c->out[v].a[k].to];
+    n += c->deleted[v];
+    return (n + CH_PRIO_BIAS) << 16 | v;
+}
+
+int ch_build( ch_t *ch
+            , uint32_t n_vert
+            , const uint32_t *off
+            , const uint16_t *dest
+            , const uint16_t *cost
+            )
+{
+    int rc = -1;
+    ctx_t c;
+    kheap_t order = {0};
+    uint32_t i = 0, k = 0, n = n_vert, r = 0, n_up = 0, n_dn = 0;
+    char *mem = NULL;
+
+    memset(ch, 0, sizeof(*ch));
+    memset(&c, 0, sizeof(c));
+    for(k = 0; k < off[n_vert]; ++k) {
+        if(dest[k] >= n) n = dest[k] + 1;
+    }
+    c.n_vert = n;
+    c.out = calloc(n, sizeof(*c.out));
+    c.in = calloc(n, sizeof(*c.in));
+    c.done = calloc(n, sizeof(*c.done));
+    c.deleted = calloc(n, sizeof(*c.deleted));
+    c.rank = calloc(n, sizeof(*c.rank));
+    c.dist = calloc(n, sizeof(*c.dist));
+    c.stamp = calloc(n, sizeof(*c.stamp));
+    if(!c.out || !c.in || !c.done || !c.deleted || !c.rank || !c.dist
+    || !c.stamp) goto cleanup;
+    for(i = 0; i < n_vert; ++i) { // parallel edges collapse in arc_link()
+        for(k = off[i]; k < off[i+1]; ++k) {
+            if(dest[k] == i) continue;
+            if(0 != arc_link(&c, i, dest[k], cost[k], 0)) goto cleanup;
+        }
+    }
+
+    for(i = 0; i < n; ++i) {
+        int64_t key = priority(&c, i);
+        if(key < 0 || 0 != kheap_push(&order, key)) goto cleanup;
+    }
+    while(order.n > 0) { // lazy updates: re-rank v if it got more expensive
+        uint16_t v = kheap_pop(&order) & 0xffff;
+        int64_t key = priority(&c, v);
+        if(key < 0) goto cleanup;
+        if(order.n > 0 && (uint64_t)key > order.k[0]) {
+            if(0 != kheap_push(&order, key)) goto cleanup;
+            continue;
+        }
+        if(contract(&c, v, 0) < 0) goto cleanup;
+        c.done[v] = 1;
+        c.rank[v] = r++;
+        for(k = 0; k < c.in[v].n; ++k) ++c.deleted[c.in[v].a[k].to];
+        for(k = 0; k < c.out[v].n; ++k) ++c.deleted[c.out[v].a[k].to];
+    }
+
+    for(i = 0; i < n; ++i) {
+        for(k = 0; k < c.out[i].n; ++k) n_up += c.rank[c.out[i].a[k].to] > c.rank[i];
+        for(k = 0; k < c.in[i].n; ++k) n_dn += c.rank[c.in[i].a[k].to] > c.rank[i];
+    }
+    mem = malloc(sizeof(*ch->uoff) * 2 * ((size_t)n + 1)
+               + sizeof(*ch->up) * ((size_t)n_up + n_dn)
+               + sizeof(*ch->rank) * n);
+    if(!mem) goto cleanup;
+    ch->uoff = (uint32_t *)mem;
+    ch->doff = ch->uoff + n + 1;
+    ch->up = (ch_arc_t *)(ch->doff + n + 1);
+    ch->dn = ch->up + n_up;
+    ch->rank = (uint16_t *)(ch->dn + n_dn);
+    ch->n_vert = n;
+    ch->n_up = n_up;
+    ch->n_dn = n_dn;
+    ch->owned = 1;
+    ch->uoff[0] = ch->doff[0] = 0;
+    for(i = 0, n_up = n_dn = 0; i < n; ++i) {
+        ch->rank[i] = c.rank[i];
+        for(k = 0; k < c.out[i].n; ++k) {
+            if(c.rank[c.out[i].a[k].to] > c.rank[i]) ch->up[n_up++] = c.out[i].a[k];
+        }
+        for(k = 0; k < c.in[i].n; ++k) {
+            if(c.rank[c.in[i].a[k].to] > c.rank[i]) ch->dn[n_dn++] = c.in[i].a[k];
+        }
+        ch->uoff[i+1] = n_up;
+        ch->doff[i+1] = n_dn;
+    }
+    rc = 0;
+cleanup:
+    for(i = 0; c.out && c.in && i < n; ++i) {
+        free(c.out[i].a);
+        free(c.in[i].a);
+    }
+    free(c.out);
+    free(c.in);
+    free(c.done);
+    free(c.deleted);
+    free(c.rank);
+    free(c.dist);
+    free(c.stamp);
+    free(c.h.k);
+    free(order.k);
+    return rc;
+}
+
+uint16_t ch_mid( const ch_t *ch
+               , uint16_t a
+               , uint16_t b
+               )
+{
+    uint32_t k = 0;
+
+    if(a >= ch->n_vert || b >= ch->n_vert) return 0;
+    if(ch->rank[a] < ch->rank[b]) {
+        for(k = ch->uoff[a]; k < ch->uoff[a+1]; ++k) {
+            if(ch->up[k].to == b) return ch->up[k].mid;
+        }
+    } else {
+        for(k = ch->doff[b]; k < ch->doff[b+1]; ++k) {
+            if(ch->dn[k].to == a) return ch->dn[k].mid;
+        }
+    }
+    return 0;
+}
+
+void ch_free(ch_t *ch)
+{
+    if(ch->owned) free(ch->uoff);
+    memset(ch, 0, sizeof(*ch));
+}
@@ -0,0 +1,88 @@
+/* Contraction Hierarchies for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+
+/* A contraction hierarchy ranks every vertex and adds shortcut arcs so that
+ * a shortest path always climbs to its highest-ranked vertex and descends
+ * from it. A query searches upward from the start over up and upward from
+ * the end over dn (reversed), and each shortcut is unpacked through mid.
+ *
+ * The arcs of vertex i are up[uoff[i]] .. up[uoff[i+1]-1] and likewise for
+ * dn: up holds the arcs leaving i toward higher-ranked vertices, dn the
+ * arcs entering i from higher-ranked vertices (to is their source)
+ */
+typedef struct {
+    uint16_t to;    // the other end of the arc
+    uint16_t mid;   // the vertex a shortcut was contracted through; 0 if the
+                    // arc is an edge of the graph
+    uint32_t cost;  // shortcuts can cost more than any 16-bit edge
+} ch_arc_t;
+
+typedef struct {
+    uint32_t n_vert;  // number of vertices ranked; 0 if there is no hierarchy
+    uint32_t n_up;    // number of entries in up
+    uint32_t n_dn;    // number of entries in dn
+    uint32_t *uoff;   // n_vert+1 offsets into up; owns the allocation
+    uint32_t *doff;   // n_vert+1 offsets into dn
+    ch_arc_t *up;
+    ch_arc_t *dn;
+    uint16_t *rank;   // contraction order of each vertex
+    int owned;        // 0 if the arrays point into a mapped graph file
+} ch_t;
+
+/* Build the contraction hierarchy of a CSR graph
+ *
+ * Requires:
+ *   - The CSR arrays of a graph (see graph_t in main.c); vertex ids < 65536
+ *   - A reference to a ch_t to fill in
+ *
+ * Guarantees:
+ *   - Vertices are contracted in order of edge difference (shortcuts added
+ *     minus arcs removed) plus contracted neighbours, updated lazily
+ *   - A shortcut is only skipped when a bounded witness search finds a path
+ *     at least as short; extra shortcuts cost space, never correctness
+ *   - Parallel edges and self loops are dropped (the cheapest edge is kept)
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int ch_build( ch_t *ch
+            , uint32_t n_vert
+            , const uint32_t *off
+            , const uint16_t *dest
+            , const uint16_t *cost
+            );
+
+// Returns the vertex the arc a->b was contracted through; 0 for an edge
+uint16_t ch_mid( const ch_t *ch
+               , uint16_t a
+               , uint16_t b
+               );
+
+// Releases a hierarchy built by ch_build()
+void ch_free(ch_t *ch);
+
+#endif // CH_H
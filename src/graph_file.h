@@ -0,0 +1,83 @@
+/* Memory-mapped Graph File Format for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GRAPH_FILE_H
+#define GRAPH_FILE_H
+
+#include <stdint.h>
+
+/* A graph file holds a graph already in the CSR layout the server searches,
+ * so it can be mmap'd and queried without parsing or copying. All fields are
+ * in host byte order, like the messages the server accepts.
+ *
+ *   graph_file_hdr_t
+ *   graph_file_sect_t[n_sect]
+ *   sections; each starts on a GRAPH_FILE_ALIGN boundary
+ *
+ * Every graph file has the SECT_OFF, SECT_DEST and SECT_COST sections; the
+ * outbound edges of vertex i are dest[off[i]] .. dest[off[i+1]-1]. The
+ * optional SECT_ROFF, SECT_RSRC and SECT_RCOST sections hold the reverse
+ * adjacency in the same layout (rn_vert is the SECT_ROFF length minus 1).
+ * The optional SECT_CH_* sections hold a contraction hierarchy; its n_vert
+ * (which may differ from the graph's) is the SECT_CH_RANK length. Readers
+ * skip section types they don't know.
+ *
+ * A wide graph file has 4-byte SECT_DEST and SECT_COST elements (see the
+ * section widths) and ids up to WIDE_ID_MAX; only its SECT_OFF, SECT_DEST
+ * and SECT_COST sections are read.
+ */
+#define GRAPH_FILE_MAGIC "DJKG"
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_ALIGN 8
+
+typedef struct {
+    char magic[4];     // GRAPH_FILE_MAGIC
+    uint32_t version;  // GRAPH_FILE_VERSION
+    uint32_t n_vert;   // number of vertices with an entry in off
+    uint32_t n_edge;   // number of entries in dest and cost
+    uint32_t n_sect;   // number of entries in the section table
+    uint32_t pad[3];
+} graph_file_hdr_t;
+
+enum {
+    SECT_OFF = 1,      // n_vert+1 edge offsets (uint32_t)
+    SECT_DEST = 2,     // n_edge destination vertex ids (uint16_t or uint32_t)
+    SECT_COST = 3,     // n_edge edge costs (uint16_t or uint32_t)
+    SECT_ROFF = 4,     // rn_vert+1 inbound edge offsets (uint32_t)
+    SECT_RSRC = 5,     // n_edge source vertex ids of the inbound edges
+    SECT_RCOST = 6,    // n_edge inbound edge costs
+    SECT_CH_RANK = 7,  // contraction order of each vertex (uint16_t)
+    SECT_CH_UOFF = 8,  // n_vert+1 offsets into SECT_CH_UP (uint32_t)
+    SECT_CH_UP = 9,    // ch_arc_t arcs to higher-ranked vertices (see ch.h)
+    SECT_CH_DOFF = 10, // n_vert+1 offsets into SECT_CH_DN (uint32_t)
+    SECT_CH_DN = 11    // ch_arc_t arcs from higher-ranked vertices
+};
+
+typedef struct {
+    uint32_t type;     // SECT_*
+    uint32_t width;    // bytes per element
+    uint64_t off;      // offset of the section from the start of the file
+    uint64_t size;     // bytes in the section
+} graph_file_sect_t;
+
+#endif // GRAPH_FILE_H
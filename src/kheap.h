@@ -0,0 +1,80 @@
+/* Preprocessing Key Heap for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef KHEAP_H
+#define KHEAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Min heap of 64-bit keys: (key << 16) | vertex, used by the preprocessing
+// searches of ch.c and alt.c. Stale entries are skipped by the caller
+// instead of being updated in place
+typedef struct {
+    uint64_t *k;
+    uint32_t n;
+    uint32_t cap;
+} kheap_t;
+
+// Pushes a key onto the heap, growing it as needed; returns 0 or -1
+static inline int kheap_push( kheap_t *h
+                            , uint64_t k
+                            )
+{
+    uint32_t i = 0;
+
+    if(h->n == h->cap) {
+        uint32_t cap = h->cap ? h->cap * 2 : 64;
+        uint64_t *p = realloc(h->k, sizeof(*p) * cap);
+        if(!p) return -1;
+        h->k = p;
+        h->cap = cap;
+    }
+    for(i = h->n++; i > 0; ) {
+        uint32_t p = (i - 1) / 2;
+        if(h->k[p] <= k) break;
+        h->k[i] = h->k[p];
+        i = p;
+    }
+    h->k[i] = k;
+    return 0;
+}
+
+// Pops the smallest key off a non-empty heap
+static inline uint64_t kheap_pop(kheap_t *h)
+{
+    uint64_t top = h->k[0], last = h->k[--h->n];
+    uint32_t i = 0, c = 0;
+
+    if(0 == h->n) return top;
+    while((c = 2 * i + 1) < h->n) {
+        if(c + 1 < h->n && h->k[c+1] < h->k[c]) ++c;
+        if(last <= h->k[c]) break;
+        h->k[i] = h->k[c];
+        i = c;
+    }
+    h->k[i] = last;
+    return top;
+}
+
+#endif // KHEAP_H
@@ -31,33 +31,194 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stddef.h>
+
+#include "graph_file.h"
+#include "solver.h"
+#include "cache.h"
+#include "numa.h"
+#include "uring.h"
 
 #define LISTEN_PORT 7777
-#define VERT_IDX_MAX 65536 /* Valid indices: 1-65535; invalid index: 0 */
+#define QUEUE_MB 64 // default bound of the edges queued for the solvers (-Q)
+
+/* Extended requests
+ *
+ * A message whose first 2 bytes (the start vertex of a problem) are 0 is an
+ * extended request rather than a problem, since vertex 0 is never valid:
+ *   2 bytes: 0
+ *   1 byte:  opcode (OP_*)
+ *   1 byte:  flags specific to the opcode
+ *   followed by the body of the opcode, if any
+ * Every message is an even number of bytes long, so messages pipelined on a
+ * connection stay 2-byte aligned in the receive buffer.
+ */
+enum {
+    OP_PROBLEM = 0, // never sent; marks a start/end/edges problem
+    OP_HELLO = 1,   // flags become the session flags; no body and no reply
+    OP_LOAD = 2,    // 2 bytes: # edges, then the edges of a problem; the
+                    // graph becomes resident and the reply is its id
+                    // (LOAD_CH flag: also build its contraction hierarchy,
+                    // LOAD_ALT flag: also pick its landmarks,
+                    // LOAD_REORDER flag: renumber its vertices first; ids
+                    // of requests & replies are unchanged)
+    OP_QUERY = 3,   // 2 bytes each: graph id, start & end; solved on the
+                    // resident graph with the same reply as a problem
+    OP_SOLVE = 4,   // a problem (start, end, count & edges); unlike a bare
+                    // problem, the flags pick the algorithm
+    OP_WLOAD = 5,   // a wide problem (see below); its graph becomes
+                    // resident like OP_LOAD's; start & end are ignored
+    OP_WSOLVE = 6,  // a wide problem, solved like OP_SOLVE
+    OP_WQUERY = 7,  // 2 bytes: graph id, 4 bytes each: start & end;
+                    // OP_QUERY with wide ids
+    OP_MATRIX = 8,  // 2 bytes each: graph id, # sources & # targets, then
+                    // the source & target ids; graph id 0 is followed by
+                    // a problem whose graph is searched (start & end are
+                    // ignored). The reply is the distance of every pair
+                    // (MATRIX_PATHS flag: the path of every pair)
+    OP_TREE = 9,    // 2 bytes each: graph id & start; graph id 0 is
+                    // followed by a problem, as for OP_MATRIX. The reply
+                    // is the shortest path tree from start (see tree())
+    OP_STATS = 10,  // no body; the reply is the server's counters in text
+    OP_UPDATE = 11  // 2 bytes each: graph id & # deltas, then the deltas
+                    // (see DELTA_*) applied in order to the resident graph
+                    // as a new version; the reply is the id, as for OP_LOAD
+};
+#define SESSION_FRAMED 0x01 // connection stays open; replies are prefixed by
+                            // their length (4 bytes) and not NUL-terminated
+#define SESSION_BINARY 0x02 // replies are bin_reply_t rather than text
+#define LOAD_CH 0x01 // OP_LOAD flag: preprocess the graph for ALGO_CH
+#define LOAD_ALT 0x02 // OP_LOAD flag: preprocess the graph for ALGO_ALT
+#define LOAD_REORDER 0x04 // OP_LOAD flag: renumber the graph for locality
+#define MATRIX_PATHS 0x01 // OP_MATRIX flag: reply with paths, not distances
+
+// The search algorithm (ALGO_*) of an OP_QUERY or OP_SOLVE is the low bits
+// of its flags
+#define QUERY_ALGO_MASK 0x0f
+
+#define MSG_EXT_SZ 4 // 0, opcode & flags
+#define MSG_QUERY_SZ 10 // extended header, graph id, start & end
+#define MSG_WQUERY_SZ 14 // extended header, graph id, wide start & end
+
+#define MSG_MATRIX_SZ 10 // extended header, graph id, # sources & # targets
+#define MSG_TREE_SZ 8 // extended header, graph id & start
+#define MATRIX_CELL_MAX (1u << 22) // pairs an OP_MATRIX may have
 
-struct edge {
-    uint16_t dest;       // The index of the destination
-    uint16_t cost;       // The cost to follow the edge to dest
-    struct edge *next;   // Next edge in list
+// An OP_UPDATE delta is 4 2-byte values: kind, source, sync & cost
+#define MSG_UPDATE_SZ 8 // extended header, graph id & # deltas
+#define MSG_DELTA_SZ 8
+enum {
+    DELTA_COST = 0, // every source->sync edge gets the cost
+    DELTA_ADD = 1,  // a source->sync edge of the cost is added
+    DELTA_DEL = 2   // every source->sync edge is removed; cost is ignored
 };
-typedef struct edge edge_t;
 
-// A vertex id of 0 is invalid. Therefore, 0 is used as NULL or empty
+#define RESIDENT_MAX 65536 // Valid graph ids: 1-65535; invalid id: 0
+
+// Incremental message parser state; see parse_msg()
+enum { PARSE_HDR, PARSE_LISTS, PARSE_COUNT, PARSE_EDGES, PARSE_DONE };
+typedef struct {
+    int state;     // PARSE_* state
+    size_t need;   // bytes of the message needed before the parser can advance
+    uint8_t op;    // OP_PROBLEM or the opcode of an extended request
+    uint8_t flags; // flags of an extended request
+    size_t body;   // offset of the problem (start, end, count & edges), if any
+    csr_sizes_t sz; // wide edge records counted while they were received
+} parse_t;
+
+// A vertex of a shortest path tree reply
+typedef struct {
+    uint16_t id;
+    uint16_t prev;   // parent in the tree; 0 for the start
+    uint32_t dist;   // distance from the start
+} tree_rec_t;
+
+// Per-connection protocol state
+typedef struct {
+    uint8_t flags; // SESSION_* flags set by OP_HELLO
+} session_t;
+
+// A reply ready to send: the frame header of framed sessions, then the body
 typedef struct {
-    // Edge data
-    edge_t *head;   // list of all outbound edges
-    edge_t *tail;   // tail pointer for edge list
-    // Traversal metadata
-    uint32_t dist;  // current shortest distance to vertex
-    char visited;   // vertex has been visited or not
-    uint16_t prev;  // last vertex in shortest path here
-    uint16_t q_idx; // queue index; used by push/pop & heapify-{up,down}
-} vertex_t;
+    uint32_t frame;       // length of the body
+    struct iovec iov[2];  // frame header (empty if unframed) and body
+} reply_t;
+
+#define IO_READ_CHUNK 65536 // minimum free space offered to each read
+
+// Replaced resident graphs are freed once no message received before the
+// replacement is still being served. Every scratch space is registered so
+// the writer can check (see resident_reclaim)
+static uint64_t resident_gen = 1; // bumped by each replacement
+static scratch_t **readers = NULL;
+static uint32_t n_readers = 0, readers_cap = 0;
+static pthread_mutex_t readers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Registers the scratch space as a reader of resident graphs; 0 or -1
+int reader_add(scratch_t *w)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&readers_lock);
+    if(n_readers == readers_cap) {
+        uint32_t cap = readers_cap ? readers_cap * 2 : 16;
+        scratch_t **r = realloc(readers, sizeof(*r) * cap);
+        if(r) {
+            readers = r;
+            readers_cap = cap;
+        }
+    }
+    if(n_readers < readers_cap) readers[n_readers++] = w;
+    else rc = -1;
+    pthread_mutex_unlock(&readers_lock);
+    return rc;
+}
+
+// Unregisters the scratch space, if it was registered
+void reader_remove(scratch_t *w)
+{
+    uint32_t i = 0;
+
+    pthread_mutex_lock(&readers_lock);
+    for(i = 0; i < n_readers; ++i) {
+        if(readers[i] == w) {
+            readers[i] = readers[--n_readers];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&readers_lock);
+}
+// Resets the parser for a new message
+void parse_init(parse_t *p)
+{
+    p->state = PARSE_HDR;
+    p->need = MSG_EXT_SZ;
+    p->op = OP_PROBLEM;
+    p->flags = 0;
+    p->body = 0;
+    memset(&p->sz, 0, sizeof(p->sz));
+}
 
-/* Load the graph from a binary file
+// Bytes an OP_LOAD or OP_WLOAD may have (-u); 0 for no cap. Set once the
+// options are read, so -g files are never refused
+static size_t upload_max = 0;
+
+/* Advance the message parser over the bytes of a message received so far
  *
  * Requires:
- *   - A fd to read a binary directed graph from
+ *   - A parser initialized with parse_init() and only fed this message
+ *   - The first len bytes of the message; a problem is laid out as
  *     - The first 2 bytes should be the start vertex id
  *     - The second 2 bytes should be the stop vertex id
  *     - The third 2 bytes should be the number of edges that follow
@@ -65,441 +226,3058 @@ typedef struct {
  *       2 bytes: unsigned int [1-65535] (source vertex)
  *       2 bytes: unsigned int [1-65535] (sync vertex)
  *       2 bytes: unsigned int [1-65535] (edge cost from source to sync)
- *     - There are no delimiters between entries
- *     - Read access on the fd is granted
- *   - A reference to a vertex_t array of size VERT_IDX_MAX to store data
+ *   - or is an extended request (see OP_*); the problem of an OP_SOLVE (or
+ *     the wide problem of an OP_WSOLVE or OP_WLOAD, or the problem of an
+ *     OP_MATRIX or OP_TREE of graph id 0) starts at p->body
+ *
+ * Guarantees:
+ *   - The parser can be resumed any number of times as bytes trickle in;
+ *     p->need is the total message size required to make progress
+ *   - 1 will be returned once the message is complete (p->need bytes long)
+ *   - 0 will be returned if more bytes are needed
+ *   - The edge records of a wide problem are sized (p->sz) as they arrive
+ *   - -1 will be returned if the message is malformed (unknown opcode, a
+ *     wide problem of more than WIDE_EDGE_MAX edges or an OP_MATRIX of more
+ *     than MATRIX_CELL_MAX pairs) or is an upload of more than upload_max
+ *     bytes, before its edges are received
+ */
+int parse_msg( parse_t *p
+             , const char *msg
+             , size_t len
+             )
+{
+    uint16_t u16 = 0;
+    uint32_t u32 = 0;
+
+    while(PARSE_DONE != p->state && len >= p->need) {
+        switch(p->state) {
+            case PARSE_HDR:
+                memcpy(&u16, msg, sizeof(u16));
+                if(0 != u16) {
+                    p->need = MSG_HDR_SZ;
+                    p->state = PARSE_COUNT;
+                    break;
+                }
+                p->op = msg[2];
+                p->flags = msg[3];
+                switch(p->op) {
+                    case OP_HELLO:
+                    case OP_STATS: p->state = PARSE_DONE; break;
+                    case OP_LOAD: // count sits where a problem's does
+                        p->need = MSG_HDR_SZ;
+                        p->state = PARSE_COUNT;
+                        break;
+                    case OP_SOLVE:
+                        p->body = MSG_EXT_SZ;
+                        p->need = p->body + MSG_HDR_SZ;
+                        p->state = PARSE_COUNT;
+                        break;
+                    case OP_QUERY:
+                        p->need = MSG_QUERY_SZ;
+                        p->state = PARSE_EDGES;
+                        break;
+                    case OP_WLOAD:
+                    case OP_WSOLVE:
+                        p->body = MSG_EXT_SZ;
+                        p->need = p->body + MSG_WHDR_SZ;
+                        p->state = PARSE_COUNT;
+                        break;
+                    case OP_WQUERY:
+                        p->need = MSG_WQUERY_SZ;
+                        p->state = PARSE_EDGES;
+                        break;
+                    case OP_MATRIX:
+                        p->need = MSG_MATRIX_SZ;
+                        p->state = PARSE_LISTS;
+                        break;
+                    case OP_TREE:
+                        p->need = MSG_TREE_SZ;
+                        p->state = PARSE_LISTS;
+                        break;
+                    case OP_UPDATE:
+                        p->need = MSG_UPDATE_SZ;
+                        p->state = PARSE_LISTS;
+                        break;
+                    default: return -1;
+                }
+                break;
+            case PARSE_LISTS: { // OP_MATRIX lists; the graph of both ops
+                uint16_t id = 0, n_src = 0, n_dst = 0;
+                memcpy(&id, msg + 4, sizeof(id));
+                if(OP_UPDATE == p->op) { // its deltas; never a problem
+                    memcpy(&n_src, msg + 6, sizeof(n_src));
+                    p->body = MSG_UPDATE_SZ;
+                    p->need = p->body + (size_t)n_src * MSG_DELTA_SZ;
+                    p->state = PARSE_EDGES;
+                    break;
+                }
+                p->body = MSG_TREE_SZ;
+                if(OP_MATRIX == p->op) {
+                    memcpy(&n_src, msg + 6, sizeof(n_src));
+                    memcpy(&n_dst, msg + 8, sizeof(n_dst));
+                    if((uint32_t)n_src * n_dst > MATRIX_CELL_MAX) return -1;
+                    p->body = MSG_MATRIX_SZ
+                            + ((size_t)n_src + n_dst) * sizeof(id);
+                }
+                p->need = p->body + (0 == id ? MSG_HDR_SZ : 0);
+                p->state = 0 == id ? PARSE_COUNT : PARSE_EDGES;
+                break;
+            }
+            case PARSE_COUNT:
+                if(OP_WLOAD == p->op || OP_WSOLVE == p->op) {
+                    memcpy(&u32, msg + p->body + 8, sizeof(u32));
+                    if(u32 > WIDE_EDGE_MAX) return -1;
+                    p->need = p->body + MSG_WHDR_SZ + (size_t)u32 * MSG_WREC_SZ;
+                } else {
+                    memcpy(&u16, msg + p->body + 4, sizeof(u16));
+                    p->need = p->body + MSG_HDR_SZ + (size_t)u16 * MSG_REC_SZ;
+                }
+                if((OP_LOAD == p->op || OP_WLOAD == p->op)
+                && upload_max && p->need > upload_max) return -1;
+                p->state = PARSE_EDGES;
+                break;
+            case PARSE_EDGES:
+                p->state = PARSE_DONE;
+                break;
+        }
+    }
+    if((OP_WLOAD == p->op || OP_WSOLVE == p->op)
+    && (PARSE_EDGES == p->state || PARSE_DONE == p->state)) {
+        // size the records received so far while the rest arrive; only this
+        // sizing pass overlaps the receive, the build itself (see wbuild_csr)
+        // starts once the last record is in
+        size_t recs = p->body + MSG_WHDR_SZ, have = len < p->need ? len : p->need;
+        uint32_t n = (have - recs) / MSG_WREC_SZ - p->sz.n_rec;
+        csr_sizes_t add;
+        wcsr_count(msg + recs + (size_t)p->sz.n_rec * MSG_WREC_SZ, n
+                  , &add.n_vert
+                  , &add.n_ids
+                  , &add.n_edge
+                  );
+        if(add.n_vert > p->sz.n_vert) p->sz.n_vert = add.n_vert;
+        if(add.n_ids > p->sz.n_ids) p->sz.n_ids = add.n_ids;
+        p->sz.n_edge += add.n_edge;
+        p->sz.n_rec += n;
+    }
+    return PARSE_DONE == p->state;
+}
+
+/* Make room to receive the rest of the current message
+ *
+ * Requires:
+ *   - The size the current message needs so far (parse_t.need)
  *
  * Guarantees:
- *   - The contents of the file will be loaded into the vertex_t array
+ *   - At least the rest of the message and no less than IO_READ_CHUNK bytes
+ *     can be received after len
+ *   - Unparsed bytes are moved to the front only when the buffer is full
  *   - 0 will be returned on success
- *   - -1 will be returned on error
+ *   - -1 will be returned if the allocation fails
  */
-int load_map( int fd
-            , vertex_t *v
-            , uint16_t *start
-            , uint16_t *end
-            )
+int inbuf_reserve( inbuf_t *in
+                 , size_t need
+                 )
+{
+    size_t have = in->len - in->off;
+    size_t want = need > have ? need - have : 0;
+
+    if(want < IO_READ_CHUNK) want = IO_READ_CHUNK;
+    if(in->len + want > in->b.cap && in->off > 0) {
+        memmove(in->b.p, in->b.p + in->off, have);
+        in->off = 0;
+        in->len = have;
+    }
+    return buf_reserve(&in->b, in->len + want);
+}
+
+// Drops the current (complete) message and readies the parser for the next
+void inbuf_consume( inbuf_t *in
+                  , parse_t *p
+                  )
+{
+    in->off += p->need;
+    if(in->off == in->len) in->off = in->len = 0;
+    parse_init(p);
+}
+
+/* Receive the next complete message from the fd
+ *
+ * Requires:
+ *   - A fd to read messages from (see parse_msg)
+ *   - The connection's receive buffer and a parser reset for a new message
+ *
+ * Guarantees:
+ *   - Reads pull as much as is available (up to the buffer), so a message is
+ *     received in a few large reads; extra bytes are kept for the next one
+ *   - The message starts at in->b.p + in->off and is p->need bytes long
+ *   - If first isn't NULL and is 0, it is set to the time the first read
+ *     returned bytes (see metrics_now)
+ *   - The message size will be returned on success
+ *   - 0 will be returned on EOF before the first byte of the message
+ *   - -1 will be returned on error (including truncated or malformed input)
+ */
+ssize_t read_msg( int fd
+                , inbuf_t *in
+                , parse_t *p
+                , uint64_t *first
+                )
 {
-    int rc = -1;
-    uint16_t i = 0, n = 0;
     ssize_t r = 0;
-    uint16_t num_vert = 0;
-    edge_t *e = NULL;
-
-    r = read(fd, start, sizeof(*start));
-    if(sizeof(*start) != r) goto cleanup;
-    r = read(fd, end, sizeof(*end));
-    if(sizeof(*end) != r) goto cleanup;
-    r = read(fd, &num_vert, sizeof(num_vert));
-    if(sizeof(num_vert) != r) goto cleanup;
-    for(; n < num_vert; ++n) {
-        r = read(fd, &i, sizeof(i));
-        if(sizeof(i) != r) goto cleanup;
-        e = malloc(sizeof(*e));
-        memset(e, 0, sizeof(*e));
-        if(!v[i].head) {
-            v[i].head = e;
-            v[i].tail = v[i].head;
-        }
-        else {
-            v[i].tail->next = e;
-            v[i].tail = v[i].tail->next;
-        }
-        r = read(fd, &v[i].tail->dest, sizeof(v[i].tail->dest));
-        if(sizeof(v[i].tail->dest) != r) goto cleanup;
-        r = read(fd, &v[i].tail->cost, sizeof(v[i].tail->cost));
-        if(sizeof(v[i].tail->cost) != r) goto cleanup;
+    int rc = 0;
+
+    while(0 == (rc = parse_msg(p, in->b.p + in->off, in->len - in->off))) {
+        if(0 != inbuf_reserve(in, p->need)) return -1;
+        r = read(fd, in->b.p + in->len, in->b.cap - in->len);
+        if(-1 == r && EINTR == errno) continue;
+        if(r <= 0) return (0 == r && in->len == in->off) ? 0 : -1;
+        if(first && 0 == *first) *first = metrics_now();
+        in->len += r;
     }
-    rc = 0;
-cleanup:
-    return rc;
+    return rc < 0 ? -1 : (ssize_t)p->need;
 }
 
-// Returns 1 if a < b (0 is treated as infinity); otherwise, returns 0
-int lt( uint16_t a
-      , uint16_t b
-      )
+// Graphs loaded once and queried many times. A slot is written under
+// resident_lock, and the graph it points to is never modified afterwards,
+// so workers read it without locking; OP_UPDATE replaces it with a new
+// version (see resident_update)
+static const graph_t *resident[RESIDENT_MAX]; // the g of a resident_t
+static uint32_t resident_edges[RESIDENT_MAX]; // n_edge of each slot's graph,
+                                              // read without being a reader
+static uint32_t resident_n = 0; // ids handed out so far
+static pthread_mutex_t resident_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// A resident graph version and its copies on each NUMA node (-R), which
+// are freed with it
+typedef struct {
+    graph_t g;
+    graph_t *replica[NUMA_NODE_MAX]; // made by the first reader on the node
+} resident_t;
+static int replicate = 0; // readers search the copy on their node (-R)
+static size_t uploads_max = 0;   // bytes all uploads may have (-r); 0 for any
+static size_t uploads_bytes = 0; // bytes of the uploads made resident
+
+/* Account an upload against the bytes all uploads may have
+ *
+ * Requires:
+ *   - The size of an upload message, or minus it to give back the bytes
+ *     of an upload that failed to load
+ *
+ * Guarantees:
+ *   - The bytes are added unless uploads_max would be exceeded; bytes
+ *     given back are always taken off
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the upload would exceed uploads_max
+ */
+int upload_charge(ssize_t bytes)
 {
-    // a != infinity and ( a < b or b == infinity)
-    if(a != 0 && (a < b || b == 0)) return 1;
+    size_t cur = __atomic_load_n(&uploads_bytes, __ATOMIC_RELAXED);
+
+    do {
+        if(bytes > 0 && uploads_max && cur + bytes > uploads_max) return -1;
+    } while(!__atomic_compare_exchange_n( &uploads_bytes, &cur, cur + bytes, 1
+                                        , __ATOMIC_RELAXED, __ATOMIC_RELAXED));
     return 0;
 }
 
-// Returns 1 if a > b (0 is treated as infinity); otherwise, returns 0
-int gt( uint16_t a
-      , uint16_t b
-      )
+/* Make a graph resident
+ *
+ * Requires:
+ *   - A graph built into its own allocation (not scratch space); ownership
+ *     passes to the resident table
+ *
+ * Guarantees:
+ *   - The graph is published read-only to every worker
+ *   - Graphs are made resident with their reverse adjacency, so every
+ *     algorithm can run on them
+ *   - The id of the graph (1-65535) will be returned on success
+ *   - 0 will be returned if the table is full
+ */
+uint16_t resident_add(const graph_t *g)
+{
+    resident_t *r = calloc(1, sizeof(*r));
+    uint16_t id = 0;
+
+    if(!r) return 0;
+    r->g = *g;
+    pthread_mutex_lock(&resident_lock);
+    if(resident_n + 1 < RESIDENT_MAX) {
+        id = ++resident_n;
+        __atomic_store_n(&resident_edges[id], g->n_edge, __ATOMIC_RELAXED);
+        __atomic_store_n(&resident[id], &r->g, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&resident_lock);
+    if(0 == id) free(r);
+    return id;
+}
+
+// Returns the resident graph with the given id or NULL if there is none;
+// it stays valid until the message being served has been answered
+const graph_t * resident_get(uint16_t id)
 {
-    // b != infinity and (a > b or a == infinity)
-    if(b != 0 && (a > b || a == 0)) return 1;
-    return 0;
+    // sequentially consistent with the reader's rcu (see resident_reclaim)
+    return __atomic_load_n(&resident[id], __ATOMIC_SEQ_CST);
 }
 
-/* Should be used to set the value of any position in the queue
+/* Look a resident graph up for a search of the calling thread
  *
  * Requires:
- *   - A valid min bin heap (array) is provided
- *     - The value of the heap elements index into an array of vertices
- *   - An array of vertices is provided
- *   - The queue index to set
- *   - The vertex index to set the queue index to
+ *   - The scratch space of the caller, whose node is the NUMA node its
+ *     thread is pinned to
  *
  * Guarantees:
- *   - The value at the queue index will be set to the vertex index
- *   - The value of the vertex's q_idx will be set to the queue index
+ *   - resident_get() of the id unless graphs are replicated (-R)
+ *   - Otherwise the copy of the graph on the caller's node, made by the
+ *     caller on its first lookup (see graph_copy), so the edges its
+ *     searches read are in local memory; the copy lives as long as the
+ *     version it was made of
+ *   - The graph itself is returned if the copy can't be allocated
  */
-void q_set( vertex_t *v
-          , uint16_t *q
-          , uint16_t q_i
-          , uint16_t v_i
-          )
+const graph_t * resident_local( const scratch_t *w
+                              , uint16_t id
+                              )
 {
-    q[q_i] = v_i;
-    v[v_i].q_idx = q_i;
+    resident_t *r = (resident_t *)resident_get(id);
+    graph_t *c = NULL, *none = NULL;
+
+    if(!r || !replicate) return r ? &r->g : NULL;
+    if((c = __atomic_load_n(&r->replica[w->node], __ATOMIC_ACQUIRE))) return c;
+    if(!(c = malloc(sizeof(*c)))) return &r->g;
+    if(0 != graph_copy(c, &r->g)) {
+        free(c);
+        return &r->g;
+    }
+    if(!__atomic_compare_exchange_n( &r->replica[w->node], &none, c, 0
+                                   , __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        graph_copy_free(c); // another reader of the node copied it first
+        free(c);
+        c = none;
+    }
+    return c;
 }
 
-/* Should be used to clear the value of any position in the queue
+#define ALT_LANDMARKS 16 // default landmarks per graph
+static uint32_t alt_landmarks = ALT_LANDMARKS; // landmarks per graph (-L)
+static int alt_select = ALT_FARTHEST; // how landmarks are picked (-l)
+static int graph_order = ORDER_RCM; // numbering of uploads with LOAD_REORDER
+
+/* Pick the ALT landmarks of a graph about to become resident
  *
  * Requires:
- *   - A valid min bin heap (array) is provided
- *     - The value of the heap elements index into an array of vertices
- *   - An array of vertices is provided
- *   - The queue index to clear
+ *   - A compact graph with its reverse adjacency
+ *   - The number of landmarks, at most ALT_K_MAX; 0 for none
  *
  * Guarantees:
- *   - The vertex referenced by the queue index will have it's q_idx cleared
- *   - The value at the queue index will cleared
+ *   - alt_build() with the -l selection
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
  */
-void q_clear( vertex_t *v
-            , uint16_t *q
-            , uint16_t q_i
+int alt_prep( graph_t *g
+            , uint32_t landmarks
             )
 {
-    v[q[q_i]].q_idx = 0;
-    q[q_i] = 0;
+    if(0 == landmarks) return 0;
+    return alt_build( &g->alt, g->n_vert, g->off, g->dest, g->cost
+                    , g->rn_vert, g->roff, g->rsrc, g->rcost
+                    , landmarks, alt_select);
 }
 
-// Swaps q[a] with q[b]
-void swap( vertex_t *v
-         , uint16_t *q
-         , uint16_t a
-         , uint16_t b
-         )
+/* Make the graph of a problem or upload message resident
+ *
+ * Requires:
+ *   - A complete OP_PROBLEM or OP_LOAD message
+ *   - Whether to build the graph's contraction hierarchy (see ch_build)
+ *   - The number of ALT landmarks to pick (see alt_prep); 0 for none
+ *   - The ORDER_* numbering of its vertices (see graph_reorder), which
+ *     the hierarchy and landmarks are built in
+ *   - The metrics to time the load into, or NULL
+ *
+ * Guarantees:
+ *   - load_map() is timed as PHASE_LOAD and the rest of the build as
+ *     PHASE_BUILD, like a problem's load
+ *   - The id of the graph will be returned on success
+ *   - 0 will be returned on error
+ */
+uint16_t resident_load( const char *msg
+                      , int with_ch
+                      , uint32_t landmarks
+                      , int order
+                      , metrics_t *m
+                      )
 {
-    uint16_t s = 0;
-    s = q[a];
-    q_set(v, q, a, q[b]);
-    q_set(v, q, b, s);
+    graph_t g = {0};
+    uint16_t start = 0, end = 0, id = 0;
+    uint64_t t = metrics_now(), t_build = 0;
+
+    if(0 == load_map(msg, &g, &start, &end)) {
+        t_build = metrics_now();
+        if(m) hist_add(&m->phase[PHASE_LOAD], t_build - t);
+        if(0 == build_rev(&g) && 0 == graph_reorder(&g, order)
+        && (!with_ch || 0 == ch_build(&g.ch, g.n_vert, g.off, g.dest, g.cost))
+        && 0 == alt_prep(&g, landmarks)) {
+            if(m) hist_add(&m->phase[PHASE_BUILD], metrics_now() - t_build);
+            id = resident_add(&g);
+        }
+    }
+    if(0 == id) {
+        free(g.off);
+        free(g.roff);
+        free(g.to_ext);
+        ch_free(&g.ch);
+        alt_free(&g.alt);
+    }
+    return id;
 }
 
-/* Heapify-up the element in the queue at the provided index
+/* Make the graph of a wide problem resident
  *
  * Requires:
- *   - A valid min bin heap (array) is provided
- *     - The value of the heap elements index into an array of vertices
- *   - An array of vertices is provided with an accessible .dist member
- *     - 0 dist indicates infinity
- *   - The head of the heap starts at index 1
+ *   - A wide problem (the body of an OP_WLOAD or OP_WSOLVE message) and
+ *     the sizes its parser took, or NULL
+ *   - The metrics to time the load into, or NULL
  *
  * Guarantees:
- *   - The value at the provided index will be heapify-up'd
- *   - The heap will still be a valid min bin heap
- *   - The new index for the value at the provided index will be returned
+ *   - The graph is resident as a graph_t whose wide field holds it
+ *   - load_wmap() is timed as PHASE_LOAD
+ *   - The id of the graph will be returned on success
+ *   - 0 will be returned on error
  */
-int heapify_up( vertex_t *v
-              , uint16_t *q
-              , uint16_t i
-              )
+uint16_t resident_wload( const char *msg
+                       , const csr_sizes_t *pre
+                       , metrics_t *m
+                       )
+{
+    graph_t g = {0};
+    uint32_t start = 0, end = 0;
+    uint16_t id = 0;
+    uint64_t t = metrics_now();
+
+    g.wide = calloc(1, sizeof(*g.wide));
+    if(g.wide && 0 == load_wmap(msg, pre, g.wide, &start, &end)) {
+        if(m) hist_add(&m->phase[PHASE_LOAD], metrics_now() - t);
+        id = resident_add(&g);
+    }
+    if(0 == id && g.wide) {
+        free(g.wide->off);
+        free(g.wide);
+    }
+    return id;
+}
+
+/* Copy one direction of a CSR graph with a batch of deltas applied
+ *
+ * Requires:
+ *   - The CSR arrays of the outbound edges, or of the inbound edges with
+ *     rev set (each delta's source & sync then trade places)
+ *   - n OP_UPDATE deltas checked by graph_delta()
+ *   - References to store the new vertex count & arrays and the size of
+ *     their allocation at *off_out
+ *   - A flag to set if a delta may shorten a path: an added edge, or a
+ *     cost below the one it replaces
+ *
+ * Guarantees:
+ *   - The deltas of each vertex are applied in message order to a copy of
+ *     its edges, which keep their order; added edges follow them
+ *   - Deltas of vertices without edges that add none are no-ops
+ *   - off, adj & cost share one allocation; free(*off_out) releases it
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int csr_delta( uint32_t n_vert
+             , const uint32_t *off
+             , const uint16_t *adj
+             , const uint16_t *cost
+             , const char *deltas
+             , uint32_t n
+             , int rev
+             , uint32_t *n_out
+             , uint32_t **off_out
+             , uint16_t **adj_out
+             , uint16_t **cost_out
+             , size_t *cap_out
+             , int *lowers
+             )
 {
-    int stop = 0;
+    int rc = -1;
+    uint16_t d[4], *a = NULL, *c = NULL;
+    uint32_t *first = NULL, *ord = NULL, *o = NULL;
+    uint32_t nv = n_vert, bound = n_vert ? off[n_vert] : 0, e = 0, i = 0;
+    size_t sz = 0;
+
+    for(i = 0; i < n; ++i) { // room for every added edge
+        memcpy(d, deltas + (size_t)i * MSG_DELTA_SZ, sizeof(d));
+        if(DELTA_ADD != d[0]) continue;
+        ++bound;
+        if((rev ? d[2] : d[1]) >= nv) nv = (rev ? d[2] : d[1]) + 1;
+    }
+    sz = sizeof(*o) * ((size_t)nv + 1) + sizeof(*a) * (size_t)bound * 2;
+    first = calloc((size_t)nv + 1, sizeof(*first));
+    ord = malloc(sizeof(*ord) * (n ? n : 1));
+    o = malloc(sz);
+    if(!first || !ord || !o) goto cleanup;
+    a = (uint16_t *)(o + nv + 1);
+    c = a + bound;
+    // counting sort of the deltas by vertex; those of vertex u end up at
+    // ord[first[u-1]] .. ord[first[u]-1] (from 0 for u = 0)
+    for(i = 0; i < n; ++i) {
+        memcpy(d, deltas + (size_t)i * MSG_DELTA_SZ, sizeof(d));
+        if((rev ? d[2] : d[1]) < nv) ++first[(rev ? d[2] : d[1]) + 1];
+    }
+    for(i = 1; i <= nv; ++i) first[i] += first[i-1];
+    for(i = 0; i < n; ++i) {
+        memcpy(d, deltas + (size_t)i * MSG_DELTA_SZ, sizeof(d));
+        if((rev ? d[2] : d[1]) < nv) ord[first[rev ? d[2] : d[1]]++] = i;
+    }
 
-    do { // heapify-up
-        uint16_t p = i/2;
-        stop = (i == 1) // reached top
-            || !lt(v[q[i]].dist, v[q[p]].dist); // parent < child
-        if(!stop) {
-            swap(v, q, i, p);
-            i = p;
+    for(i = 0; i < nv; ++i) {
+        uint32_t len = 0, k = 0, m = 0, j = i ? first[i-1] : 0;
+        o[i] = e;
+        if(i < n_vert) {
+            len = off[i+1] - off[i];
+            memcpy(a + e, adj + off[i], sizeof(*a) * len);
+            memcpy(c + e, cost + off[i], sizeof(*c) * len);
+        }
+        for(; j < first[i]; ++j) {
+            uint16_t to = 0;
+            memcpy(d, deltas + (size_t)ord[j] * MSG_DELTA_SZ, sizeof(d));
+            to = rev ? d[1] : d[2];
+            if(DELTA_ADD == d[0]) {
+                a[e + len] = to;
+                c[e + len] = d[3];
+                ++len;
+                *lowers = 1;
+                continue;
+            }
+            for(k = 0, m = 0; k < len; ++k) {
+                if(a[e + k] == to) {
+                    if(DELTA_DEL == d[0]) continue;
+                    if(d[3] < c[e + k]) *lowers = 1;
+                    c[e + k] = d[3];
+                }
+                a[e + m] = a[e + k];
+                c[e + m] = c[e + k];
+                ++m;
+            }
+            len = m;
         }
-    } while(!stop);
-    return i;
+        e += len;
+    }
+    o[nv] = e;
+    *n_out = nv;
+    *off_out = o;
+    *adj_out = a;
+    *cost_out = c;
+    *cap_out = sz;
+    o = NULL;
+    rc = 0;
+cleanup:
+    free(first);
+    free(ord);
+    free(o);
+    return rc;
 }
 
-/* Heapify-down the element in the queue at the provided index
+/* Build the next version of a resident graph
  *
  * Requires:
- *   - A valid min bin heap (array) is provided
- *     - The value of the heap elements index into an array of vertices
- *   - An array of vertices is provided with an accessible .dist member
- *     - 0 dist indicates infinity
- *   - The head of the heap starts at index 1
+ *   - A resident compact graph, which is left untouched
+ *   - The n deltas of an OP_UPDATE, in vertices of a renumbered graph
+ *   - A graph_t to fill in and a flag to set if it shares g's landmarks
  *
  * Guarantees:
- *   - The value at the provided index will be heapify-down'd
- *   - The heap will still be a valid min bin heap
- *   - The new index for the value at the provided index will be returned
+ *   - The new version has its own copy of the arrays of g with the deltas
+ *     applied to both directions (see csr_delta); nothing is rebuilt from
+ *     edge records
+ *   - max_cost never drops; it only has to bound the costs
+ *   - The numbering of a renumbered graph is shared
+ *   - The contraction hierarchy is dropped, so ALGO_CH falls back to
+ *     ALGO_BIDIR until the graph is uploaded again
+ *   - Landmarks are shared if no delta can shorten a path (their bounds
+ *     stay valid when distances only grow); otherwise the same landmarks
+ *     are searched again (see alt_update)
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (including a delta of an unknown kind
+ *     or of vertex 0)
  */
-int heapify_down( vertex_t *v
-                , uint16_t *q
-                , uint16_t i
-                )
+int graph_delta( graph_t *ng
+               , const graph_t *g
+               , const char *deltas
+               , uint32_t n
+               , int *shared
+               )
+{
+    uint16_t d[4];
+    uint32_t i = 0;
+    int lowers = 0, rlowers = 0;
+
+    memset(ng, 0, sizeof(*ng));
+    ng->max_cost = g->max_cost;
+    ng->to_ext = g->to_ext; // the deltas were translated (see resident_update)
+    ng->to_int = g->to_int;
+    for(i = 0; i < n; ++i) {
+        memcpy(d, deltas + (size_t)i * MSG_DELTA_SZ, sizeof(d));
+        if(d[0] > DELTA_DEL || 0 == d[1] || 0 == d[2]) return -1;
+        if(DELTA_DEL != d[0] && d[3] > ng->max_cost) ng->max_cost = d[3];
+    }
+    if(0 != csr_delta( g->n_vert, g->off, g->dest, g->cost, deltas, n, 0
+                     , &ng->n_vert, &ng->off, &ng->dest, &ng->cost, &ng->cap
+                     , &lowers)) goto error;
+    ng->n_edge = ng->off[ng->n_vert];
+    if(g->has_rev) {
+        if(0 != csr_delta( g->rn_vert, g->roff, g->rsrc, g->rcost, deltas, n, 1
+                         , &ng->rn_vert, &ng->roff, &ng->rsrc, &ng->rcost
+                         , &ng->rcap, &rlowers)) goto error;
+        ng->has_rev = 1;
+    }
+    else if(0 != build_rev(ng)) goto error;
+    ng->ver = g->ver + 1;
+    *shared = g->alt.k && !lowers;
+    if(*shared) ng->alt = g->alt;
+    else if(0 != alt_update( &ng->alt, &g->alt, ng->n_vert, ng->off, ng->dest
+                           , ng->cost, ng->rn_vert, ng->roff, ng->rsrc
+                           , ng->rcost)) goto error;
+    return 0;
+error:
+    free(ng->off);
+    free(ng->roff);
+    memset(ng, 0, sizeof(*ng));
+    return -1;
+}
+
+// A replaced resident graph, kept until no message that may read it is
+// still being served
+typedef struct retired {
+    graph_t *g;
+    uint64_t gen;         // resident_gen of the replacement
+    int keep_alt;         // its landmarks are shared by the next version
+    struct retired *next;
+} retired_t;
+static retired_t *retired = NULL; // guarded by resident_lock; serve_msg
+                                  // peeks without it
+
+/* Free the replaced graphs no message can still be reading
+ *
+ * Requires:
+ *   - resident_lock is held
+ *   - The scratch space of the caller, which reads no replaced graph
+ *
+ * Guarantees:
+ *   - A message is served with its scratch space's rcu set to resident_gen
+ *     before it looks any graph up (see serve_msg). A graph replaced at
+ *     generation gen is freed once every other reader is idle (rcu 0) or
+ *     started at gen or later, since those can only have seen its
+ *     replacement (rcu, resident_gen & the slots are sequentially
+ *     consistent)
+ *   - Graphs still in use wait for a later call: the next update's, or
+ *     that of a reader going idle (see serve_msg)
+ */
+void resident_reclaim(const scratch_t *self)
 {
-    int stop = 0;
+    retired_t **e = &retired;
+    uint64_t oldest = UINT64_MAX; // earliest generation still being served
+    uint32_t i = 0;
 
-    do { // heapify-down
-        int c1 = 2*i;
-        int c2 = 2*i+1;
-        stop = (c1 > VERT_IDX_MAX || c2 > VERT_IDX_MAX) // reached bottom
-            || !( gt(v[q[i]].dist, v[q[c1]].dist)
-               || gt(v[q[i]].dist, v[q[c2]].dist)
-                ); // parent < child
-        if(!stop) {
-            int s = lt(v[q[c1]].dist, v[q[c2]].dist) ? c1 : c2;
-            swap(v, q, i, s); // swap child with shortest distance
-            i = s;
+    pthread_mutex_lock(&readers_lock);
+    for(i = 0; i < n_readers; ++i) {
+        uint64_t r = __atomic_load_n(&readers[i]->rcu, __ATOMIC_SEQ_CST);
+        if(readers[i] != self && 0 != r && r < oldest) oldest = r;
+    }
+    pthread_mutex_unlock(&readers_lock);
+    while(*e) {
+        retired_t *x = *e;
+        if(x->gen > oldest) {
+            e = &x->next;
+            continue;
+        }
+        *e = x->next;
+        for(i = 0; i < NUMA_NODE_MAX; ++i) {
+            graph_t *c = ((resident_t *)x->g)->replica[i];
+            if(c) graph_copy_free(c);
+            free(c);
         }
-    } while(!stop);
-    return i;
+        if(x->g->cap) free(x->g->off); // 0 if it points into a graph file
+        if(x->g->rcap) free(x->g->roff);
+        ch_free(&x->g->ch);
+        if(!x->keep_alt) alt_free(&x->g->alt);
+        free(x->g); // its resident_t
+        free(x);
+    }
 }
 
-/* Push the provided index into the min bin heap
+/* Apply the deltas of an OP_UPDATE to a resident graph
  *
  * Requires:
- *   - A valid min bin heap (array) is provided
- *     - The value of the heap elements index into an array of vertices
- *   - An array of vertices is provided with an accessible .dist member
- *     - 0 dist indicates infinity
- *   - The head of the heap starts at index 1
- *   - A reference to the tail index of the heap is provided
- *   - The index to insert is provided
+ *   - The scratch space serving the update
+ *   - The id of the graph and its n deltas
  *
  * Guarantees:
- *   - The new index will be inserted into the min bin heap
- *   - The heap will still be a valid min bin heap
- *   - The tail index will be updated
+ *   - The next version (see graph_delta) replaces the graph in its slot in
+ *     one store; messages already served from the old version keep reading
+ *     it, so readers never wait. Updates are serialized by resident_lock
+ *   - Old versions are freed by resident_reclaim(), here or once their
+ *     last reader is done
+ *   - The ids of the deltas of a renumbered graph are translated to its
+ *     vertices
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (including a wide or missing graph)
  */
-int push( vertex_t *v
-        , uint16_t *q
-        , uint16_t *tail
-        , uint16_t new
-        ) {
-    uint16_t i = 0;
+int resident_update( scratch_t *w
+                   , uint16_t id
+                   , const char *deltas
+                   , uint32_t n
+                   )
+{
+    int rc = -1, shared = 0;
+    resident_t *ng = calloc(1, sizeof(*ng));
+    retired_t *e = malloc(sizeof(*e));
+    char *local = NULL; // deltas in the vertices of a renumbered graph
+    const graph_t *g = NULL;
+    uint32_t i = 0;
+
+    if(!ng || !e) goto cleanup;
+    pthread_mutex_lock(&resident_lock);
+    g = resident[id];
+    if(g && g->to_int) {
+        if(n && !(local = malloc((size_t)n * MSG_DELTA_SZ))) g = NULL;
+        for(i = 0; g && i < n; ++i) {
+            uint16_t d[4];
+            memcpy(d, deltas + (size_t)i * MSG_DELTA_SZ, sizeof(d));
+            d[1] = g->to_int[d[1]];
+            d[2] = g->to_int[d[2]];
+            memcpy(local + (size_t)i * MSG_DELTA_SZ, d, sizeof(d));
+        }
+        deltas = local;
+    }
+    if(g && !g->wide && 0 == graph_delta(&ng->g, g, deltas, n, &shared)) {
+        __atomic_store_n(&resident_edges[id], ng->g.n_edge, __ATOMIC_RELAXED);
+        __atomic_store_n(&resident[id], &ng->g, __ATOMIC_SEQ_CST);
+        e->g = (graph_t *)g; // no longer published
+        e->gen = __atomic_add_fetch(&resident_gen, 1, __ATOMIC_SEQ_CST);
+        e->keep_alt = shared;
+        e->next = retired;
+        __atomic_store_n(&retired, e, __ATOMIC_RELAXED); // see serve_msg
+        ng = NULL;
+        e = NULL;
+        resident_reclaim(w);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&resident_lock);
+cleanup:
+    free(ng);
+    free(e);
+    free(local);
+    return rc;
+}
 
-    // Add the element to the bottom level of the heap.
-    q_set(v, q, ++(*tail), new);
-    i = *tail;
+/* Map a graph file (see graph_file.h)
+ *
+ * Requires:
+ *   - A fd of a file open for reading
+ *   - A reference to store the size of the mapping
+ *
+ * Guarantees:
+ *   - The file is mapped read-only and shared, so server processes mapping
+ *     the same file share its page cache
+ *   - The header is checked, and every section lies within the file on a
+ *     GRAPH_FILE_ALIGN boundary
+ *   - The header (the start of the mapping) will be returned on success
+ *   - NULL will be returned on error (including a file that isn't a graph
+ *     file); nothing stays mapped
+ */
+const graph_file_hdr_t * graph_file_map( int fd
+                                       , size_t *size
+                                       )
+{
+    struct stat st;
+    const graph_file_hdr_t *hdr = NULL;
+    const graph_file_sect_t *sect = NULL;
+    uint32_t i = 0;
 
-    heapify_up(v, q, i);
+    if(-1 == fstat(fd, &st) || (size_t)st.st_size < sizeof(*hdr)) return NULL;
+    hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == hdr) return NULL;
+    sect = (const graph_file_sect_t *)(hdr + 1);
+    if(0 != memcmp(hdr->magic, GRAPH_FILE_MAGIC, sizeof(hdr->magic))
+    || GRAPH_FILE_VERSION != hdr->version
+    || sizeof(*hdr) + (uint64_t)hdr->n_sect * sizeof(*sect) > (size_t)st.st_size) {
+        goto error;
+    }
+    for(i = 0; i < hdr->n_sect; ++i) {
+        if(sect[i].off > (uint64_t)st.st_size
+        || sect[i].size > (uint64_t)st.st_size - sect[i].off
+        || 0 != sect[i].off % GRAPH_FILE_ALIGN) goto error;
+    }
+    *size = st.st_size;
+    return hdr;
+error:
+    munmap((void *)hdr, st.st_size);
+    return NULL;
 }
 
-/* Pop the top of the min bin heap
+/* Check the arrays of a contraction hierarchy read from a graph file
  *
  * Requires:
- *   - A valid min bin heap (array) is provided
- *     - The value of the heap elements index into an array of vertices
- *   - A vertices array is provided with an accessible .dist member
- *     - 0 dist indicates infinity
- *   - The head of the heap starts at index 1
- *   - The tail index of the heap is provided
- *   - The tail index will be updated
+ *   - A ch_t whose uoff and doff have n_vert+1 entries running from 0 to
+ *     n_up and n_dn
  *
  * Guarantees:
- *   - The index at the root of the heap will be removed
- *   - The heap will still be a valid min bin heap
+ *   - Both offset arrays are checked to be non-decreasing, so every offset
+ *     is in range, and every arc's ends to be ranked vertices
+ *   - 0 will be returned if the hierarchy can be searched
+ *   - -1 will be returned otherwise
  */
-void pop( vertex_t *v
-        , uint16_t *q
-        , uint16_t *tail
-        ) {
-    uint16_t i = 1;
+int ch_file_check( const ch_t *ch
+                 )
+{
+    uint32_t i = 0;
+
+    for(i = 0; i < ch->n_vert; ++i) {
+        if(ch->uoff[i + 1] < ch->uoff[i] || ch->doff[i + 1] < ch->doff[i]) {
+            return -1;
+        }
+    }
+    for(i = 0; i < ch->n_up; ++i) {
+        if(ch->up[i].to >= ch->n_vert || ch->up[i].mid >= ch->n_vert) return -1;
+    }
+    for(i = 0; i < ch->n_dn; ++i) {
+        if(ch->dn[i].to >= ch->n_vert || ch->dn[i].mid >= ch->n_vert) return -1;
+    }
+    return 0;
+}
 
-    // Replace the root of the heap with the last element on the last level
-    swap(v, q, i, *tail);
-    q_clear(v, q, *tail);
-    --(*tail);
+/* Map a graph file (see graph_file.h) into a graph without copying it
+ *
+ * Requires:
+ *   - A fd of a graph file open for reading
+ *   - A reference to a graph_t to point into the mapping
+ *
+ * Guarantees:
+ *   - The file is mapped by graph_file_map(); the mapping is never unmapped
+ *   - Of the arrays, only the offsets (checked to be non-decreasing and
+ *     within n_edge) and the costs (for max_cost) are read
+ *   - The reverse adjacency comes from the SECT_R* sections if the file has
+ *     them (a SECT_ROFF that isn't non-decreasing from 0 to n_edge is an
+ *     error); otherwise it is built in memory
+ *   - The contraction hierarchy comes from the SECT_CH_* sections, if the
+ *     file has all of them, they cover every vertex and they pass
+ *     ch_file_check(); otherwise the graph is served without one
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (including a file that isn't a graph file)
+ */
+int map_graph_file( int fd
+                  , graph_t *g
+                  )
+{
+    const graph_file_hdr_t *hdr = NULL;
+    const graph_file_sect_t *sect = NULL;
+    char *base = NULL;
+    ch_t *ch = NULL;
+    size_t size = 0;
+    uint64_t n_uoff = 0, n_doff = 0;
+    uint32_t i = 0, e = 0;
 
-    heapify_down(v, q, i);
+    if(!(hdr = graph_file_map(fd, &size))) return -1;
+    base = (char *)hdr;
+    sect = (const graph_file_sect_t *)(hdr + 1);
+    memset(g, 0, sizeof(*g));
+    ch = &g->ch;
+    if(hdr->n_vert > VERT_IDX_MAX) goto error;
+    for(i = 0; i < hdr->n_sect; ++i) {
+        uint64_t want = 0;
+        void *p = base + sect[i].off;
+        switch(sect[i].type) {
+            case SECT_OFF:
+                want = sizeof(*g->off) * ((uint64_t)hdr->n_vert + 1);
+                if(sizeof(*g->off) != sect[i].width) goto error;
+                g->off = p;
+                break;
+            case SECT_DEST:
+                want = sizeof(*g->dest) * (uint64_t)hdr->n_edge;
+                if(sizeof(*g->dest) != sect[i].width) goto error;
+                g->dest = p;
+                break;
+            case SECT_COST:
+                want = sizeof(*g->cost) * (uint64_t)hdr->n_edge;
+                if(sizeof(*g->cost) != sect[i].width) goto error;
+                g->cost = p;
+                break;
+            case SECT_ROFF:
+                if(sizeof(*g->roff) != sect[i].width
+                || sect[i].size < sizeof(*g->roff)
+                || sect[i].size / sizeof(*g->roff) > VERT_IDX_MAX + 1) goto error;
+                want = sect[i].size;
+                g->rn_vert = sect[i].size / sizeof(*g->roff) - 1;
+                g->roff = p;
+                break;
+            case SECT_RSRC:
+                want = sizeof(*g->rsrc) * (uint64_t)hdr->n_edge;
+                if(sizeof(*g->rsrc) != sect[i].width) goto error;
+                g->rsrc = p;
+                break;
+            case SECT_RCOST:
+                want = sizeof(*g->rcost) * (uint64_t)hdr->n_edge;
+                if(sizeof(*g->rcost) != sect[i].width) goto error;
+                g->rcost = p;
+                break;
+            case SECT_CH_RANK:
+                if(sizeof(*ch->rank) != sect[i].width
+                || sect[i].size / sizeof(*ch->rank) > VERT_IDX_MAX) goto error;
+                want = sect[i].size;
+                ch->n_vert = sect[i].size / sizeof(*ch->rank);
+                ch->rank = p;
+                break;
+            case SECT_CH_UOFF:
+            case SECT_CH_DOFF:
+                if(sizeof(*ch->uoff) != sect[i].width) goto error;
+                want = sect[i].size - sect[i].size % sizeof(*ch->uoff);
+                if(SECT_CH_UOFF == sect[i].type) {
+                    n_uoff = sect[i].size / sizeof(*ch->uoff);
+                    ch->uoff = p;
+                } else {
+                    n_doff = sect[i].size / sizeof(*ch->doff);
+                    ch->doff = p;
+                }
+                break;
+            case SECT_CH_UP:
+            case SECT_CH_DN:
+                if(sizeof(*ch->up) != sect[i].width) goto error;
+                want = sect[i].size - sect[i].size % sizeof(*ch->up);
+                if(SECT_CH_UP == sect[i].type) {
+                    ch->n_up = sect[i].size / sizeof(*ch->up);
+                    ch->up = p;
+                } else {
+                    ch->n_dn = sect[i].size / sizeof(*ch->dn);
+                    ch->dn = p;
+                }
+                break;
+            default: // unknown sections are skipped
+                want = sect[i].size;
+                break;
+        }
+        if(want != sect[i].size) goto error;
+    }
+    if(!g->off || !g->dest || !g->cost
+    || 0 != g->off[0] || hdr->n_edge != g->off[hdr->n_vert]) goto error;
+    g->n_vert = hdr->n_vert;
+    g->n_edge = hdr->n_edge;
+    for(i = 0; i < g->n_vert; ++i) {
+        // a decreasing or overlong offset would send a search off the arrays
+        if(g->off[i + 1] < g->off[i] || g->off[i + 1] > g->n_edge) goto error;
+        for(e = g->off[i]; e < g->off[i + 1]; ++e) {
+            if(g->cost[e] > g->max_cost) g->max_cost = g->cost[e];
+        }
+    }
+    if((g->has_rev = g->roff && g->rsrc && g->rcost)) {
+        // non-decreasing from 0 to n_edge, so every offset is in range
+        if(0 != g->roff[0] || g->n_edge != g->roff[g->rn_vert]) goto error;
+        for(i = 0; i < g->rn_vert; ++i) {
+            if(g->roff[i + 1] < g->roff[i]) goto error;
+        }
+    }
+    if(!g->has_rev) {
+        g->roff = NULL;
+        if(0 != build_rev(g)) goto error;
+    }
+    if(!ch->rank || !ch->uoff || !ch->up || !ch->doff || !ch->dn
+    || n_uoff != ch->n_vert + 1 || n_doff != ch->n_vert + 1
+    || ch->n_vert < g->n_vert || ch->n_vert < g->rn_vert
+    || 0 != ch->uoff[0] || ch->n_up != ch->uoff[ch->n_vert]
+    || 0 != ch->doff[0] || ch->n_dn != ch->doff[ch->n_vert]
+    || 0 != ch_file_check(ch)) {
+        memset(ch, 0, sizeof(*ch));
+    }
+    return 0;
+error:
+    munmap(base, size);
+    memset(g, 0, sizeof(*g));
+    return -1;
 }
 
-/* Performs Dijkstra's Algorithm on the provided vertices
+/* Map a wide graph file (see graph_file.h) into a wide graph
  *
  * Requires:
- *   - An array of vertices is provided with an accessible .dist member
- *     - 0 dist indicates infinity
- *   - A start index into the array of vertices is provided
- *   - An end index into the array of vertices is provided
+ *   - A fd of a graph file open for reading
+ *   - A reference to a wgraph_t to point into the mapping
  *
  * Guarantees:
- *   - The shortest path if one exists is found
- *   - The distance from start to end is returned (0 for no path)
- *   - The vertices are updated with path and distance information
+ *   - The file is mapped by graph_file_map(); the mapping is never unmapped
+ *   - The SECT_OFF, SECT_DEST & SECT_COST sections are used; the rest are
+ *     skipped. The destinations are read to find n_ids
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (including a graph file that isn't wide)
  */
-int dijkstras( vertex_t *v
-             , uint16_t start
-             , uint16_t end
-             )
+int map_wgraph_file( int fd
+                   , wgraph_t *g
+                   )
 {
-    uint16_t q[VERT_IDX_MAX] = {0}; // q holds index into v; v[0] is unused
-    uint16_t tail = 0;
-    push(v, q, &tail, start);
-
-    while(0 != q[1]) {
-        uint16_t s = q[1];
-        if(s == end) break;
-        pop(v, q, &tail);
-        v[s].visited = 1;
-        edge_t *e = v[s].head;
-        while(e) {
-            uint32_t cur = v[e->dest].dist;
-            uint32_t dist = v[s].dist + e->cost;
-            // 0 distance represents infinity
-            if(0 == v[e->dest].visited && (0 == cur || dist < cur)) {
-                v[e->dest].dist = dist;
-                v[e->dest].prev = s;
-                if(0 == v[e->dest].q_idx) push(v, q, &tail, e->dest); // add
-                else heapify_up(v, q, v[e->dest].q_idx); // update location
-            }
-            e = e->next;
+    const graph_file_hdr_t *hdr = NULL;
+    const graph_file_sect_t *sect = NULL;
+    char *base = NULL;
+    size_t size = 0;
+    uint32_t i = 0;
+
+    if(!(hdr = graph_file_map(fd, &size))) return -1;
+    base = (char *)hdr;
+    sect = (const graph_file_sect_t *)(hdr + 1);
+    memset(g, 0, sizeof(*g));
+    if(hdr->n_vert >= WIDE_ID_MAX) goto error;
+    for(i = 0; i < hdr->n_sect; ++i) {
+        uint64_t want = sect[i].size;
+        void *p = base + sect[i].off;
+        switch(sect[i].type) {
+            case SECT_OFF:
+                want = sizeof(*g->off) * ((uint64_t)hdr->n_vert + 1);
+                if(sizeof(*g->off) != sect[i].width) goto error;
+                g->off = p;
+                break;
+            case SECT_DEST:
+                want = sizeof(*g->dest) * (uint64_t)hdr->n_edge;
+                if(sizeof(*g->dest) != sect[i].width) goto error;
+                g->dest = p;
+                break;
+            case SECT_COST:
+                want = sizeof(*g->cost) * (uint64_t)hdr->n_edge;
+                if(sizeof(*g->cost) != sect[i].width) goto error;
+                g->cost = p;
+                break;
+            default: // only the forward graph is searched
+                break;
         }
+        if(want != sect[i].size) goto error;
+    }
+    if(!g->off || !g->dest || !g->cost
+    || 0 != g->off[0] || hdr->n_edge != g->off[hdr->n_vert]) goto error;
+    g->n_vert = g->n_ids = hdr->n_vert;
+    g->n_edge = hdr->n_edge;
+    for(i = 0; i < g->n_edge; ++i) {
+        if(g->dest[i] >= WIDE_ID_MAX) goto error;
+        if(g->dest[i] >= g->n_ids) g->n_ids = g->dest[i] + 1;
     }
-    return v[end].dist;
+    return 0;
+error:
+    munmap(base, size);
+    memset(g, 0, sizeof(*g));
+    return -1;
 }
 
-/* Get's the path from start to end for the listed vertices, if any
+/* Make the graph of a file resident
  *
  * Requires:
- *   - An array of vertices is provided with an accessible .dist member
- *     - 0 dist indicates infinity
- *   - The array of vertices has been processed via dijkstras()
- *   - A start index into the array of vertices is provided
- *   - An end index into the array of vertices is provided
+ *   - The path of a graph file (see graph_file.h), which is mapped, or of a
+ *     file holding a problem or upload message (e.g. data/map0.bin), either
+ *     of which may be wide
+ *   - Whether to build the contraction hierarchy of a compact graph without
+ *     one
+ *   - The number of ALT landmarks to pick for a compact graph; 0 for none
+ *   - The ORDER_* numbering of a compact graph (see graph_reorder); a graph
+ *     file with its own hierarchy keeps the numbering it was built in
  *
- * Guarantess:
- *   - A string containing the path & distance will be returned if a path exists
- *   - NULL will be returned if no path exists
+ * Guarantees:
+ *   - The id of the graph will be returned on success
+ *   - 0 will be returned on error, including a graph file that fails its
+ *     checks (it is never read as a message)
  */
-char * gen_path( vertex_t *v
-               , uint16_t start
-               , uint16_t end
-               )
+uint16_t resident_load_file( const char *path
+                           , int with_ch
+                           , uint32_t landmarks
+                           , int order
+                           )
 {
-    assert(VERT_IDX_MAX <= 65536);
-    // We will pass through each vertex at most once (65536 - 1)
-    // We will need at most 7 chars per vertices ('65535->')
-    // Add an extra '\0' terminator for each vertex
-    // This is a wasteful allocation, but we're talking 512K
-    char *path = NULL, *prepend = NULL;
-    size_t sz = VERT_IDX_MAX * sizeof(*path) * 8;
-    uint16_t i = end;
-    int h = 0, t = 0;
-    if(0 == v[end].prev) return NULL;
-    path = malloc(sz);
-    memset(path, 0, sz);
-    prepend = path + sz;
-    do { // write string from back to front
-        prepend -= 8;
-        sprintf(prepend, "%d->", i);
-        if(start == i) break;
-        i = v[i].prev;
-    } while(0 != i);
-    if(start != i) {
-        free(path);
-        return NULL;
+    inbuf_t in;
+    parse_t p;
+    graph_t g;
+    wgraph_t wg;
+    char magic[4];
+    uint16_t id = 0;
+    int fd = open(path, O_RDONLY);
+
+    if(-1 == fd) return 0;
+    if(0 == map_graph_file(fd, &g)) {
+        close(fd); // the mapping stays valid
+        if(order && 0 == g.ch.n_vert
+        && ((!g.has_rev && 0 != build_rev(&g)) || 0 != graph_reorder(&g, order))) {
+            return 0;
+        }
+        if(with_ch && 0 == g.ch.n_vert
+        && 0 != ch_build(&g.ch, g.n_vert, g.off, g.dest, g.cost)) return 0;
+        if(landmarks && !g.has_rev && 0 != build_rev(&g)) return 0;
+        if(0 != alt_prep(&g, landmarks)) return 0;
+        return resident_add(&g);
     }
-    while(t < sz && h < sz) { // remove '\0' padding in string
-        while(h < sz && 0 != path[h]) ++h;
-        if(t < h) t = h+1;
-        while(t < sz && 0 == path[t]) ++t;
-        if(t > h && t < sz) {
-            path[h] = path[t];
-            path[t] = 0;
+    if(0 == map_wgraph_file(fd, &wg)) {
+        close(fd);
+        memset(&g, 0, sizeof(g));
+        if(!(g.wide = malloc(sizeof(*g.wide)))) return 0;
+        *g.wide = wg;
+        if(0 == (id = resident_add(&g))) free(g.wide);
+        return id;
+    }
+    // a graph file that failed its checks is rejected, not read as a message
+    if(sizeof(magic) == pread(fd, magic, sizeof(magic), 0)
+    && 0 == memcmp(magic, GRAPH_FILE_MAGIC, sizeof(magic))) {
+        close(fd);
+        return 0;
+    }
+    memset(&in, 0, sizeof(in));
+    parse_init(&p);
+    if(read_msg(fd, &in, &p, NULL) > 0) {
+        if(OP_PROBLEM == p.op || OP_LOAD == p.op) {
+            id = resident_load( in.b.p + in.off, with_ch, landmarks, order
+                              , NULL);
+        }
+        else if(OP_WLOAD == p.op || OP_WSOLVE == p.op) {
+            id = resident_wload(in.b.p + in.off + p.body, &p.sz, NULL);
         }
     }
-    sprintf(path+h-2, " (%lu)\n", v[end].dist); // rm last '->'; add distance
-    return path;
+    close(fd);
+    free(in.b.p);
+    return id;
+}
+#define BUSY_TEXT "Busy\n" // reply to a message refused by admission control
+
+// Returns the busy reply of a message refused by serve_op, or NULL on
+// allocation failure; see conn_busy for those refused by an I/O thread
+char * busy_reply(scratch_t *w)
+{
+    if(w->binary) return bin_reply(w, REPLY_BUSY, 0, 0, 0);
+    if(0 != buf_reserve(&w->path, sizeof(BUSY_TEXT))) return NULL;
+    memcpy(w->path.p, BUSY_TEXT, sizeof(BUSY_TEXT));
+    return w->path.p;
+}
+
+// Returns the reply stating graph id isn't resident, or NULL on allocation
+// failure
+char * no_graph( scratch_t *w
+               , uint16_t id
+               )
+{
+    if(w->binary) return bin_reply(w, REPLY_NO_GRAPH, 0, 0, 0);
+    if(0 != buf_reserve(&w->path, 32)) return NULL;
+    snprintf(w->path.p, w->path.cap, "No graph '%d'\n", id);
+    return w->path.p;
 }
 
-/* Reads a shortest path problem from the fd, solves it, & returns the solution
+#define MATRIX_NONE UINT32_MAX // distance of a pair without a path
+
+// An OP_MATRIX being solved. Its rows (one search per source) are claimed
+// by the worker that received it and by the matrix helper threads
+typedef struct {
+    const graph_t *g;
+    const char *src;    // n_src source ids; unaligned
+    const char *dst;    // n_dst target ids; unaligned
+    uint32_t n_src;
+    uint32_t n_dst;
+    int paths;          // rows hold the path replies of their pairs
+    int binary;         // the path replies are bin_reply_t
+    uint32_t *dist;     // n_src * n_dst distances, row by row
+    buf_t *rows;        // n_src rows of path replies, if paths
+    size_t *row_len;    // bytes of each row
+    uint32_t next;      // next row to claim
+    uint32_t done;      // rows finished
+    int failed;         // a row failed to allocate
+} matrix_t;
+
+// The matrix whose rows the helpers claim; one at a time, so a matrix
+// received while another is spread is solved by its worker alone
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;  // a matrix was posted
+    pthread_cond_t done;  // the last row of the posted matrix finished
+    matrix_t *job;
+} matrix_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+                , PTHREAD_COND_INITIALIZER, NULL };
+static int matrix_helpers = 0; // helper threads; set before any are started
+
+/* Solves one row of a matrix
  *
  * Requires:
- *   - A valid client fd to read from
- *   - All messages sent over fd comply with the load_map contract
+ *   - Scratch space of the calling thread
+ *   - A row claimed from the matrix
  *
  * Guarantees:
- *   - A string containing the shortest path and distance, if one exists
- *   - NULL if no path exists
+ *   - One search from the row's source settles all of its targets
+ *   - The row's distances (0 from a source to itself) are filled in, and
+ *     its path replies too if paths are wanted
  */
-char * shortest_path(int fd)
+void matrix_row( scratch_t *w
+               , matrix_t *m
+               , uint32_t r
+               )
 {
-    int i = 0, rc = -1;
-    size_t sz = 0;
-    vertex_t *v = NULL;
-    char *path = NULL;
-    uint32_t dist = 0;
     uint16_t start = 0, end = 0;
+    uint32_t j = 0, *dist = m->dist + (size_t)r * m->n_dst;
 
-    sz = sizeof(*v) * VERT_IDX_MAX;
-    v = malloc(sz);
-    memset(v, 0, sz);
-
-    rc = load_map(fd, v, &start, &end);
-    if(0 != rc) goto cleanup;
+    if(0 == m->n_dst) return;
+    memcpy(&start, m->src + r * sizeof(start), sizeof(start));
+    w->binary = m->binary;
+    scratch_next_epoch(w);
+    dijkstras_many(m->g, w, graph_vert(m->g, start), m->dst, m->n_dst);
+    for(j = 0; j < m->n_dst; ++j) {
+        vertex_t *t = NULL;
+        memcpy(&end, m->dst + j * sizeof(end), sizeof(end));
+        t = touch(w, graph_vert(m->g, end));
+        dist[j] = start == end ? 0 : (0 == t->dist ? MATRIX_NONE : t->dist);
+        if(m->paths) {
+            char *path = gen_path( w, m->g->to_ext, graph_vert(m->g, start)
+                                 , graph_vert(m->g, end));
+            size_t len = 0;
+            if(!path) path = no_path(w, start, end);
+            if(!path) { m->failed = 1; return; }
+            len = w->binary ? w->reply_len : strlen(path);
+            if(0 != buf_reserve(&m->rows[r], m->row_len[r] + len)) {
+                m->failed = 1;
+                return;
+            }
+            memcpy(m->rows[r].p + m->row_len[r], path, len);
+            m->row_len[r] += len;
+        }
+    }
+}
 
-    dist = dijkstras(v, start, end);
-    path = gen_path(v, start, end);
-    if(NULL == path) asprintf( &path
-                             , "No path from '%d' to '%d'\n"
-                             , start
-                             , end
-                             );
+// Solves the rows of the posted matrix as they become available
+void * matrix_main(void *arg)
+{
+    scratch_t *w = arg;
 
-cleanup:
-    for(; i < VERT_IDX_MAX; ++i) {
-        edge_t *e = v[i].head;
-        while(e) {
-            edge_t* c = e;
-            e = e->next;
-            free(c);
+    pthread_mutex_lock(&matrix_pool.lock);
+    for(;;) {
+        matrix_t *m = matrix_pool.job;
+        uint32_t r = 0;
+        if(!m || m->next >= m->n_src) {
+            pthread_cond_wait(&matrix_pool.work, &matrix_pool.lock);
+            continue;
         }
+        r = m->next++;
+        pthread_mutex_unlock(&matrix_pool.lock);
+        matrix_row(w, m, r);
+        pthread_mutex_lock(&matrix_pool.lock);
+        // m stays valid until its last row is counted
+        if(++m->done == m->n_src) pthread_cond_signal(&matrix_pool.done);
     }
-    free(v);
-    return path;
+    return NULL;
 }
 
-int main()
+/* Formats the reply of a solved matrix
+ *
+ * Guarantees:
+ *   - Binary: a REPLY_MATRIX bin_reply_t and its distances (MATRIX_NONE
+ *     for no path), or with paths the bin_reply_t of every pair
+ *   - Text: a line per source of its distances separated by spaces ('-'
+ *     for no path), or with paths the text reply of every pair
+ *   - Pairs are in row order: every target of the first source first
+ *   - NULL will be returned on allocation failure
+ */
+char * matrix_reply( scratch_t *w
+                   , const matrix_t *m
+                   )
 {
-    int fd = socket(PF_INET, SOCK_STREAM, 0);
-    int cli_fd = 0;
-    struct sockaddr_in cli_addr;
-    socklen_t cli_len = sizeof(struct sockaddr_in);
-    struct sockaddr_in sa;
+    size_t cells = (size_t)m->n_src * m->n_dst, len = 0, i = 0;
+    char *out = NULL;
 
-    if(-1 == fd) {
-        fprintf(stderr, "Socket Error: %s\n", strerror(errno));
-        return 1;
+    w->binary = m->binary;
+    if(m->paths) {
+        for(i = 0; i < m->n_src; ++i) len += m->row_len[i];
+        if(0 != buf_reserve(&w->path, len + 1)) return NULL;
+        for(i = 0, out = w->path.p; i < m->n_src; ++i) {
+            if(m->row_len[i]) memcpy(out, m->rows[i].p, m->row_len[i]);
+            out += m->row_len[i];
+        }
+        *out = '\0';
+        w->reply_len = len;
+        return w->path.p;
     }
-    memset(&sa, 0, sizeof(struct sockaddr_in));
-    memset(&cli_addr, 0, sizeof(struct sockaddr_in));
-    sa.sin_port = htons(LISTEN_PORT);
-    sa.sin_addr = (struct in_addr) {0};
-    if(-1 == bind(fd, (struct sockaddr*)&sa, sizeof(struct sockaddr_in))) {
-        fprintf(stderr, "Bind Error: %s\n", strerror(errno));
-        return 1;
+    if(m->binary) {
+        if(!(out = bin_reply(w, REPLY_MATRIX, sizeof(*m->dist), cells, m->n_dst))) {
+            return NULL;
+        }
+        memcpy(out + sizeof(bin_reply_t), m->dist, sizeof(*m->dist) * cells);
+        return out;
     }
-    if(-1 == listen(fd, 5)) {
-        fprintf(stderr, "Listen Error: %s\n", strerror(errno));
-        return 1;
+    if(0 != buf_reserve(&w->path, cells * 11 + m->n_src + 1)) return NULL;
+    for(i = 0, out = w->path.p; i < cells; ++i) { // '4294967294 ' per cell
+        uint32_t n = dec_len(m->dist[i]);
+        if(MATRIX_NONE == m->dist[i]) *out++ = '-';
+        else out = dec_put(out + n, m->dist[i]) + n;
+        *out++ = (i + 1) % m->n_dst ? ' ' : '\n';
     }
-    while(-1 != (cli_fd = accept(fd, (struct sockaddr*)&cli_addr, &cli_len)))
-    {
-        char *path = shortest_path(cli_fd);
-        if(!path) {
-            fprintf(stderr, "Shortest path error\n");
-            return -1;
-        }
-        write(cli_fd, path, strlen(path)+1);
-        free(path);
-        close(cli_fd);
+    *out = '\0';
+    return w->path.p;
+}
+
+/* Finds the shortest path tree of start on the provided graph
+ *
+ * Requires:
+ *   - Scratch space initialized with scratch_init()
+ *   - The graph; loaded into the scratch space via load_map or resident
+ *   - The root of the tree
+ *
+ * Guarantees:
+ *   - The search runs until every reachable vertex is settled
+ *   - A REPLY_TREE bin_reply_t whose tree_rec_t are the reached vertices
+ *     (the start included) in id order will be returned; unreached
+ *     vertices are left out, and a renumbered graph's are replied in ids
+ *   - NULL will be returned on allocation failure
+ */
+char * tree( scratch_t *w
+           , const graph_t *g
+           , uint16_t start
+           )
+{
+    tree_rec_t t;
+    uint32_t id = 0, n = 0;
+    uint16_t s = graph_vert(g, start), i = 0;
+    char *out = NULL;
+
+    scratch_next_epoch(w);
+    dijkstras_many(g, w, s, NULL, 0);
+    for(id = 1; id < VERT_IDX_MAX; ++id) {
+        n += w->v[id].epoch == w->epoch && w->v[id].visited;
+    }
+    if(!(out = bin_reply(w, REPLY_TREE, sizeof(t), n, start))) return NULL;
+    out += sizeof(bin_reply_t);
+    for(id = 1; id < VERT_IDX_MAX; ++id) { // records in id order
+        i = graph_vert(g, id);
+        if(w->v[i].epoch != w->epoch || !w->v[i].visited) continue;
+        t.id = id;
+        t.prev = i == s ? 0 : graph_id(g, w->v[i].prev);
+        t.dist = w->v[i].dist;
+        memcpy(out, &t, sizeof(t));
+        out += sizeof(t);
+    }
+    return w->path.p;
+}
+
+/* Solves an OP_MATRIX on the provided graph
+ *
+ * Requires:
+ *   - Scratch space initialized with scratch_init()
+ *   - The graph; loaded into the scratch space via load_map or resident
+ *   - The OP_MATRIX message and its flags
+ *
+ * Guarantees:
+ *   - Each source is searched once (see dijkstras_many); the rows are
+ *     spread over the matrix helpers when they are free
+ *   - The reply of matrix_reply() will be returned
+ *   - NULL will be returned on allocation failure
+ */
+char * matrix( scratch_t *w
+             , const graph_t *g
+             , const char *msg
+             , uint8_t flags
+             )
+{
+    matrix_t m;
+    uint16_t n_src = 0, n_dst = 0;
+    uint32_t r = 0;
+    char *path = NULL;
+    int posted = 0;
+
+    memcpy(&n_src, msg + 6, sizeof(n_src));
+    memcpy(&n_dst, msg + 8, sizeof(n_dst));
+    memset(&m, 0, sizeof(m));
+    m.g = g;
+    m.src = msg + MSG_MATRIX_SZ;
+    m.dst = m.src + (size_t)n_src * sizeof(n_src);
+    m.n_src = n_src;
+    m.n_dst = n_dst;
+    m.paths = flags & MATRIX_PATHS;
+    m.binary = w->binary;
+    m.dist = malloc(sizeof(*m.dist) * ((size_t)n_src * n_dst + 1));
+    if(m.paths) {
+        m.rows = calloc((size_t)n_src + 1, sizeof(*m.rows));
+        m.row_len = calloc((size_t)n_src + 1, sizeof(*m.row_len));
+    }
+    if(!m.dist || (m.paths && (!m.rows || !m.row_len))) goto cleanup;
+
+    pthread_mutex_lock(&matrix_pool.lock);
+    if(matrix_helpers > 0 && n_src > 1 && !matrix_pool.job) {
+        matrix_pool.job = &m;
+        posted = 1;
+        pthread_cond_broadcast(&matrix_pool.work);
+    }
+    while(m.next < m.n_src) {
+        r = m.next++;
+        pthread_mutex_unlock(&matrix_pool.lock);
+        matrix_row(w, &m, r);
+        pthread_mutex_lock(&matrix_pool.lock);
+        ++m.done;
+    }
+    while(m.done < m.n_src) pthread_cond_wait(&matrix_pool.done, &matrix_pool.lock);
+    if(posted) matrix_pool.job = NULL;
+    pthread_mutex_unlock(&matrix_pool.lock);
+    if(!m.failed) path = matrix_reply(w, &m);
+cleanup:
+    for(r = 0; m.rows && r < m.n_src; ++r) free(m.rows[r].p);
+    free(m.rows);
+    free(m.row_len);
+    free(m.dist);
+    return path;
+}
+
+static uint64_t tree_hits = 0;   // queries answered from a cached tree
+static uint64_t tree_misses = 0; // queries that found no cached tree
+
+/* Key the reply of a message in the result cache
+ *
+ * Guarantees:
+ *   - The key covers the whole message and the reply format, so a hit has
+ *     the bytes that were sent for the same message before
+ *   - OP_TREE of a resident graph is keyed by graph id & start alone, so
+ *     tree_path() can find it; its flags don't change its reply
+ *   - Messages naming a resident graph are also keyed by its version, so
+ *     replies from before an OP_UPDATE are never hit again
+ */
+void msg_key( cache_key_t *k
+            , const parse_t *p
+            , const char *msg
+            , int binary
+            )
+{
+    char t[MSG_TREE_SZ] = {0, 0, OP_TREE, 0};
+    uint16_t id = 0;
+    uint64_t ver = 0;
+    const graph_t *g = NULL;
+
+    if(OP_QUERY == p->op || OP_WQUERY == p->op || OP_MATRIX == p->op
+    || OP_TREE == p->op) { // the graph id follows the extended header
+        memcpy(&id, msg + 4, sizeof(id));
+        if(0 != id && (g = resident_get(id))) ver = (uint64_t)g->ver << 1;
+    }
+    if(OP_TREE == p->op && 0 != id) {
+        memcpy(t + 4, msg + 4, MSG_TREE_SZ - 4);
+        cache_key(k, t, sizeof(t), ver | 1);
+        return;
+    }
+    cache_key(k, msg, p->need, ver | binary);
+}
+
+/* Answers a query from the cached shortest path tree of its start, if any
+ *
+ * Requires:
+ *   - Scratch space initialized with scratch_init()
+ *   - A resident compact graph id and the query's start & end
+ *
+ * Guarantees:
+ *   - The path is walked up the tree from end and laid on the prev chain
+ *     of the scratch space, so the reply is formatted by gen_path(); the
+ *     records, and so the chain, are in ids (see tree)
+ *   - The reply (a path or no path) will be returned on a hit
+ *   - NULL will be returned if no tree of start is cached
+ */
+char * tree_path( scratch_t *w
+                , uint16_t id
+                , uint16_t start
+                , uint16_t end
+                )
+{
+    char t[MSG_TREE_SZ] = {0, 0, OP_TREE, 0}, *path = NULL;
+    parse_t p;
+    cache_key_t k;
+    bin_reply_t hdr;
+    tree_rec_t rec;
+    const char *recs = NULL;
+    long len = 0;
+    uint32_t hops = 0;
+    uint16_t i = end;
+
+    memcpy(t + 4, &id, sizeof(id));
+    memcpy(t + 6, &start, sizeof(start));
+    parse_init(&p);
+    p.op = OP_TREE;
+    p.need = sizeof(t);
+    msg_key(&k, &p, t, 1);
+    // the query's own lookup was counted; this one only counts as a tree's
+    if((len = cache_probe(&k, &w->tree.p, &w->tree.cap)) < (long)sizeof(hdr)) {
+        __atomic_add_fetch(&tree_misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    __atomic_add_fetch(&tree_hits, 1, __ATOMIC_RELAXED);
+    memcpy(&hdr, w->tree.p, sizeof(hdr));
+    recs = w->tree.p + sizeof(hdr);
+    scratch_next_epoch(w);
+    while(hops++ <= hdr.n_vert) { // a tree has no cycles; a bad one stops
+        uint32_t lo = 0, hi = hdr.n_vert; // records are in id order
+        while(lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            memcpy(&rec, recs + (size_t)mid * sizeof(rec), sizeof(rec));
+            if(rec.id < i) lo = mid + 1;
+            else hi = mid;
+        }
+        if(lo == hdr.n_vert) break;
+        memcpy(&rec, recs + (size_t)lo * sizeof(rec), sizeof(rec));
+        if(rec.id != i) break; // unreached
+        touch(w, i)->dist = rec.dist;
+        if(start == i) break;
+        w->v[i].prev = rec.prev;
+        i = rec.prev;
+    }
+    path = gen_path(w, NULL, start, end);
+    return path ? path : no_path(w, start, end);
+}
+
+// Formats the cache counters and the metrics of every thread into the
+// buffer, as replied to OP_STATS; returns NULL on allocation failure
+char * stats(buf_t *b)
+{
+    cache_stats_t st;
+    size_t len = 0;
+
+    cache_stats(&st);
+    if(0 != buf_reserve(b, 512 + METRICS_FORMAT_MAX)) return NULL;
+    len = snprintf(b->p, b->cap, "cache_hits %llu\n"
+                                 "cache_misses %llu\n"
+                                 "cache_tree_hits %llu\n"
+                                 "cache_tree_misses %llu\n"
+                                 "cache_evictions %llu\n"
+                                 "cache_entries %llu\n"
+                                 "cache_bytes %llu\n"
+            , (unsigned long long)st.hits
+            , (unsigned long long)st.misses
+            , (unsigned long long)__atomic_load_n(&tree_hits, __ATOMIC_RELAXED)
+            , (unsigned long long)__atomic_load_n(&tree_misses, __ATOMIC_RELAXED)
+            , (unsigned long long)st.evictions
+            , (unsigned long long)st.entries
+            , (unsigned long long)st.bytes
+            );
+    metrics_format(b->p + len, b->cap - len);
+    return b->p;
+}
+
+// Returns the reply naming a resident graph id, or NULL on allocation failure
+char * id_reply( scratch_t *w
+               , uint16_t id
+               )
+{
+    if(w->binary) return bin_reply(w, REPLY_LOADED, 0, 0, id);
+    if(0 != buf_reserve(&w->path, 16)) return NULL;
+    snprintf(w->path.p, w->path.cap, "%d\n", id);
+    return w->path.p;
+}
+
+// load_map() of a received problem into the scratch graph, timed as
+// PHASE_LOAD; 0 or -1
+int load_problem( scratch_t *w
+                , const char *msg
+                , uint16_t *start
+                , uint16_t *end
+                )
+{
+    uint64_t t = metrics_now();
+    if(0 != load_map(msg, &w->g, start, end)) return -1;
+    hist_add(&w->m.phase[PHASE_LOAD], metrics_now() - t);
+    return 0;
+}
+
+/* Handles one complete message of a session
+ *
+ * Requires:
+ *   - Scratch space initialized with scratch_init()
+ *   - The session the message was received on
+ *   - The parser that completed the message, and the message
+ *   - A reply_t to describe the reply
+ *
+ * Guarantees:
+ *   - OP_HELLO updates the session flags and has an empty reply
+ *   - A problem or query is solved with the algorithm its flags pick; its
+ *     reply is the path text. Wide problems and graphs are solved by wsolve()
+ *   - An upload is made resident; its reply is the graph id in text
+ *   - An update replaces a resident graph with its next version (see
+ *     resident_update); its reply is the graph id as well
+ *   - A matrix is solved by matrix() and a tree by tree(), whose reply is
+ *     always binary; wide graphs are an error
+ *   - With the result cache enabled (-c), replies are looked up by msg_key()
+ *     before anything is loaded or searched, and stored after; queries also
+ *     look for a cached tree of their start (see tree_path)
+ *   - OP_STATS replies with the cache counters and the metrics (see stats)
+ *   - SESSION_BINARY sessions get a bin_reply_t in place of any text
+ *   - Text replies are NUL-terminated in unframed sessions, and every reply
+ *     is prefixed by its length in framed ones
+ *   - The reply points into the scratch space until the next request
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int serve_op( scratch_t *w
+            , session_t *ss
+            , const parse_t *p
+            , const char *msg
+            , reply_t *r
+            )
+{
+    char *path = NULL;
+    const graph_t *g = NULL;
+    uint16_t start = 0, end = 0, id = 0;
+    uint32_t wstart = 0, wend = 0;
+    int algo = ALGO_DIJKSTRA, cacheable = 0;
+    cache_key_t k;
+    long len = 0;
+    uint64_t t = 0;
+
+    memset(r, 0, sizeof(*r));
+    w->binary = ss->flags & SESSION_BINARY;
+    if(OP_TREE == p->op) w->binary = 1; // trees are only sent in binary
+    if(OP_STATS == p->op) w->binary = 0;
+    cacheable = cache_enabled() && OP_HELLO != p->op && OP_LOAD != p->op
+             && OP_WLOAD != p->op && OP_STATS != p->op && OP_UPDATE != p->op;
+    if(cacheable) { // a hit skips loading, searching & formatting
+        msg_key(&k, p, msg, w->binary);
+        if((len = cache_get(&k, &w->path.p, &w->path.cap)) >= 0) {
+            path = w->path.p;
+            w->reply_len = len;
+            goto reply;
+        }
+    }
+    switch(p->op) {
+        case OP_HELLO:
+            ss->flags = p->flags;
+            return 0;
+        case OP_STATS:
+            path = stats(&w->path);
+            break;
+        case OP_PROBLEM:
+        case OP_SOLVE:
+            algo = p->flags & QUERY_ALGO_MASK;
+            if(algo > ALGO_ALT) return -1;
+            if(0 != load_problem(w, msg + p->body, &start, &end)) return -1;
+            if((ALGO_BIDIR == algo || ALGO_CH == algo)
+            && 0 != build_rev(&w->g)) return -1;
+            path = solve(w, &w->g, start, end, algo);
+            break;
+        case OP_WSOLVE:
+            if((p->flags & QUERY_ALGO_MASK) > ALGO_ALT) return -1;
+            t = metrics_now();
+            if(0 != load_wmap(msg + p->body, &p->sz, &w->wg, &wstart, &wend)) return -1;
+            hist_add(&w->m.phase[PHASE_LOAD], metrics_now() - t);
+            path = wsolve(w, &w->wg, wstart, wend);
+            break;
+        case OP_LOAD:
+        case OP_WLOAD:
+            if(0 != upload_charge(p->need)) { // -r is used up
+                metric_add(&w->m.busy, 1);
+                path = busy_reply(w);
+                break;
+            }
+            if(OP_LOAD == p->op) {
+                id = resident_load( msg, LOAD_CH & p->flags
+                                  , LOAD_ALT & p->flags ? alt_landmarks : 0
+                                  , LOAD_REORDER & p->flags ? graph_order : 0
+                                  , &w->m);
+            }
+            else id = resident_wload(msg + p->body, &p->sz, &w->m);
+            if(0 == id) {
+                upload_charge(-(ssize_t)p->need);
+                return -1;
+            }
+            path = id_reply(w, id);
+            break;
+        case OP_UPDATE: {
+            uint16_t n = 0;
+            memcpy(&id, msg + 4, sizeof(id));
+            memcpy(&n, msg + 6, sizeof(n));
+            if(!resident_get(id)) path = no_graph(w, id);
+            else if(0 != resident_update(w, id, msg + p->body, n)) return -1;
+            else path = id_reply(w, id);
+            break;
+        }
+        case OP_QUERY:
+        case OP_WQUERY:
+            memcpy(&id, msg + 4, sizeof(id));
+            if(OP_QUERY == p->op) {
+                memcpy(&start, msg + 6, sizeof(start));
+                memcpy(&end, msg + 8, sizeof(end));
+                wstart = start;
+                wend = end;
+            } else {
+                memcpy(&wstart, msg + 6, sizeof(wstart));
+                memcpy(&wend, msg + 10, sizeof(wend));
+            }
+            algo = p->flags & QUERY_ALGO_MASK;
+            if(algo > ALGO_ALT) return -1;
+            g = resident_local(w, id);
+            if(g && g->wide) path = wsolve(w, g->wide, wstart, wend);
+            else if(g && (wstart >= VERT_IDX_MAX || wend >= VERT_IDX_MAX)) {
+                path = no_path(w, wstart, wend);
+            }
+            else if(g) {
+                if(cacheable) path = tree_path(w, id, wstart, wend);
+                if(!path) path = solve(w, g, wstart, wend, algo);
+            }
+            else path = no_graph(w, id);
+            cacheable = cacheable && g; // the graph may be uploaded later
+            break;
+        case OP_MATRIX:
+            memcpy(&id, msg + 4, sizeof(id));
+            if(0 == id && 0 != load_problem(w, msg + p->body, &start, &end)) {
+                return -1;
+            }
+            g = 0 == id ? &w->g : resident_local(w, id);
+            if(g && g->wide) return -1; // compact graphs only
+            path = g ? matrix(w, g, msg, p->flags) : no_graph(w, id);
+            cacheable = cacheable && g;
+            break;
+        case OP_TREE:
+            memcpy(&id, msg + 4, sizeof(id));
+            memcpy(&start, msg + 6, sizeof(start));
+            if(0 == id && 0 != load_problem(w, msg + p->body, &end, &end)) {
+                return -1;
+            }
+            g = 0 == id ? &w->g : resident_local(w, id);
+            if(g && g->wide) return -1; // compact graphs only
+            path = g ? tree(w, g, start) : no_graph(w, id);
+            cacheable = cacheable && g;
+            break;
+        default:
+            return -1;
+    }
+    if(!path) return -1;
+    if(cacheable) cache_put(&k, path, w->binary ? w->reply_len : strlen(path));
+reply:
+    r->iov[1].iov_base = path;
+    r->iov[1].iov_len = w->binary ? w->reply_len : strlen(path);
+    if(ss->flags & SESSION_FRAMED) {
+        r->frame = r->iov[1].iov_len;
+        r->iov[0].iov_base = &r->frame;
+        r->iov[0].iov_len = sizeof(r->frame);
+    }
+    else if(!w->binary) {
+        ++r->iov[1].iov_len; // legacy replies include the '\0'
+    }
+    return 0;
+}
+
+/* Handles one complete message of a session as a reader of resident graphs
+ *
+ * Guarantees:
+ *   - serve_op() of the message; no resident graph it looks up is freed
+ *     until it returns (see resident_reclaim)
+ *   - Replaced graphs no other reader can still see are then freed, unless
+ *     an update holds resident_lock
+ *   - The message, and whether it failed, are counted in the metrics
+ */
+int serve_msg( scratch_t *w
+             , session_t *ss
+             , const parse_t *p
+             , const char *msg
+             , reply_t *r
+             )
+{
+    int rc = 0;
+
+    __atomic_store_n( &w->rcu, __atomic_load_n(&resident_gen, __ATOMIC_SEQ_CST)
+                    , __ATOMIC_SEQ_CST);
+    rc = serve_op(w, ss, p, msg, r);
+    __atomic_store_n(&w->rcu, 0, __ATOMIC_RELEASE);
+    // the last reader of a replaced graph frees it rather than leaving it to
+    // the next update; if an update holds the lock, it reclaims instead
+    if(__atomic_load_n(&retired, __ATOMIC_RELAXED)
+    && 0 == pthread_mutex_trylock(&resident_lock)) {
+        resident_reclaim(w);
+        pthread_mutex_unlock(&resident_lock);
+    }
+    metric_add(&w->m.requests, 1);
+    if(0 != rc) metric_add(&w->m.errors, 1);
+    return rc;
+}
+
+// Returns 1 if the session ends once the message has been answered
+int session_done( const session_t *ss
+                , const parse_t *p
+                )
+{
+    return !(ss->flags & SESSION_FRAMED) && OP_HELLO != p->op;
+}
+
+/* Write the whole reply to the fd
+ *
+ * Guarantees:
+ *   - Writes are retried until every byte has been written
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int write_reply( int fd
+               , reply_t *r
+               )
+{
+    struct iovec iov[2] = { r->iov[0], r->iov[1] };
+    struct iovec *v = iov;
+    int n = 2;
+
+    while(n > 0) {
+        ssize_t w = 0;
+        if(0 == v->iov_len) {
+            ++v;
+            --n;
+            continue;
+        }
+        w = writev(fd, v, n);
+        if(-1 == w && EINTR == errno) continue;
+        if(w <= 0) return -1;
+        while(n > 0 && (size_t)w >= v->iov_len) {
+            w -= v->iov_len;
+            ++v;
+            --n;
+        }
+        if(n > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+/* Serves every message a blocking client sends, in order
+ *
+ * Requires:
+ *   - A valid client fd and when it was accepted (see metrics_now)
+ *   - Scratch space initialized with scratch_init()
+ *
+ * Guarantees:
+ *   - Unframed sessions end after their first problem; framed sessions go
+ *     on until the client closes the connection between messages
+ *   - The wait for the first byte and the writes of the replies are timed
+ *     as PHASE_FIRST_BYTE and PHASE_WRITE
+ *   - Pipelined messages are answered in the order they were sent
+ *   - 0 will be returned once the session is over (even if a reply could
+ *     not be written because the client went away)
+ *   - -1 will be returned if a message could not be read or answered
+ */
+int serve_conn( int fd
+              , uint64_t accepted
+              , scratch_t *w
+              )
+{
+    session_t ss = {0};
+    parse_t p;
+    reply_t r;
+    ssize_t n = 0;
+    uint64_t first = 0, t = 0;
+    int done = 0;
+
+    w->in.off = w->in.len = 0;
+    parse_init(&p);
+    while(!done) {
+        n = read_msg(fd, &w->in, &p, &first);
+        if(accepted && first) {
+            hist_add(&w->m.phase[PHASE_FIRST_BYTE], first - accepted);
+            accepted = 0;
+        }
+        if(0 == n && (ss.flags & SESSION_FRAMED)) return 0;
+        if(n <= 0) return -1;
+        if(0 != serve_msg(w, &ss, &p, w->in.b.p + w->in.off, &r)) return -1;
+        t = metrics_now();
+        if(0 != write_reply(fd, &r)) return 0;
+        hist_add(&w->m.phase[PHASE_WRITE], metrics_now() - t);
+        done = session_done(&ss, &p);
+        inbuf_consume(&w->in, &p);
+    }
+    return 0;
+}
+
+/* Create a listening socket on the provided port
+ *
+ * Requires:
+ *   - The port to listen on and the listen backlog
+ *
+ * Guarantees:
+ *   - The socket is bound with SO_REUSEADDR and SO_REUSEPORT, so every I/O
+ *     thread can own a listener on the same port and the kernel spreads
+ *     connections
+ *   - The listening fd will be returned on success
+ *   - -1 will be returned on error (and the error is reported on stderr)
+ */
+int listen_socket( uint16_t port
+                 , int backlog
+                 )
+{
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    struct sockaddr_in sa;
+
+    if(-1 == fd) {
+        fprintf(stderr, "Socket Error: %s\n", strerror(errno));
+        return -1;
+    }
+    if(-1 == setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on))
+    || -1 == setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+        fprintf(stderr, "Socket Option Error: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    memset(&sa, 0, sizeof(struct sockaddr_in));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    if(-1 == bind(fd, (struct sockaddr*)&sa, sizeof(struct sockaddr_in))) {
+        fprintf(stderr, "Bind Error: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if(-1 == listen(fd, backlog)) {
+        fprintf(stderr, "Listen Error: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Prefers the listener for connections whose packets the kernel handles on
+// the CPU of the thread accepting them (-P); without it, or on kernels that
+// lack SO_INCOMING_CPU, reuseport spreads them by hash
+void listen_steer( int fd
+                 , int cpu
+                 )
+{
+    if(-1 != cpu) setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+}
+
+struct jobq;
+
+// A solver thread; each owns all memory a request needs
+typedef struct {
+    pthread_t tid;
+    int fd;              // listening socket shared by every blocking worker
+    int cpu;             // CPU the thread is pinned to; -1 if it isn't (-P)
+    struct jobq *jobs;   // problems from the I/O threads of its NUMA node
+                         // when fd is unused
+    scratch_t w;         // preallocated vertex/queue/path arena
+} worker_t;
+
+/* Accepts clients on the shared listener and serves them one at a time
+ *
+ * Requires:
+ *   - A worker_t with an open listener and initialized scratch space
+ *
+ * Guarantees:
+ *   - Each accepted client's session is served (see serve_conn) and closed
+ *   - Workers accept from one listen queue, so a worker held by a long
+ *     framed session never strands connections the others could take
+ *   - A client whose message is malformed, truncated or can't be answered is
+ *     dropped; the worker goes on with the next client
+ */
+void * worker_main(void *arg)
+{
+    worker_t *wk = arg;
+    int cli_fd = 0;
+
+    while(-1 != (cli_fd = accept(wk->fd, NULL, NULL)) || EINTR == errno) {
+        if(-1 == cli_fd) continue;
+        serve_conn(cli_fd, metrics_now(), &wk->w); // errors are counted
+        close(cli_fd);
+    }
+    fprintf(stderr, "Accept Error: %s\n", strerror(errno));
+    return NULL;
+}
+
+/* Event-driven front end
+ *
+ * I/O threads own a non-blocking SO_REUSEPORT listener and an edge-triggered
+ * epoll set. They accept clients, feed received bytes to each connection's
+ * parser and hand fully received problems to the solver threads through a
+ * shared job queue. Solvers copy the reply into the connection and pass it
+ * back to the owning I/O thread, which writes it without blocking. A slow
+ * client therefore only costs a connection slot, never a thread.
+ *
+ * The job queue is bounded by the edge bytes of the problems it holds (see
+ * job_cost): a message that would take it over the bound is answered
+ * "Busy" (REPLY_BUSY in binary) by the I/O thread right away, so the wait
+ * of admitted messages stays bounded under overload. A malformed or
+ * truncated message only closes its own connection.
+ *
+ * With -U the I/O threads run an io_uring instead of the epoll set (see
+ * uring_main); connections, job queue and solvers are the same.
+ */
+enum { CONN_READ, CONN_SOLVE, CONN_WRITE, CONN_DEAD };
+
+struct io_thread;
+
+typedef struct conn {
+    int fd;
+    int state;             // CONN_READ, CONN_SOLVE, CONN_WRITE or CONN_DEAD
+    int last;              // close once the reply has been written
+    session_t ss;
+    parse_t p;             // parser of the message being received
+    inbuf_t in;            // bytes received
+    buf_t out;             // reply being written
+    size_t out_len;
+    size_t out_off;        // bytes of the reply already written
+    uint64_t accepted;     // metrics_now() of the accept; 0 once a byte came
+    uint64_t ready;        // metrics_now() of the reply being complete
+    size_t cost;           // job_cost() of the message being solved
+    uint32_t pending;      // io_uring operations in flight (-U)
+    struct io_thread *io;  // owning I/O thread
+    struct conn *next;     // job queue, completion or dead list link
+} conn_t;
+
+// Problems waiting for a solver thread
+typedef struct jobq {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    conn_t *head;
+    conn_t *tail;
+    size_t bytes;          // job_cost() of the queued problems
+    size_t max;            // bound of bytes; 0 admits everything (-Q)
+} jobq_t;
+
+typedef struct io_thread {
+    pthread_t tid;
+    int fd;                // non-blocking listener
+    int cpu;               // CPU the thread is pinned to; -1 if it isn't (-P)
+    int ep;                // epoll set
+    int efd;               // eventfd signalled when replies are ready
+    uring_t ring;          // io_uring replacing ep (-U); ring.fd is -1 if
+                           // the thread runs epoll
+    uint64_t wake;         // eventfd count read by the ring
+    pthread_mutex_t lock;  // protects done
+    conn_t *done;          // connections whose reply is ready
+    conn_t *dead;          // closed connections, freed after each epoll batch
+    jobq_t *jobs;          // the queue of the solvers of its NUMA node
+    metrics_t m;           // first byte & write phases of its connections
+} io_thread_t;
+
+/* Returns the bytes of edges a complete message would search, as uploaded
+ *
+ * Guarantees:
+ *   - Problems cost their size; queries, trees and matrices of resident
+ *     graphs cost the graph's edge records, once per matrix source
+ *   - OP_HELLO and OP_STATS cost 0, so they are always admitted
+ */
+size_t job_cost( const parse_t *p
+               , const char *msg
+               )
+{
+    uint16_t id = 0, n_src = 1;
+    size_t cost = 0;
+
+    switch(p->op) {
+        case OP_HELLO:
+        case OP_STATS:
+            return 0;
+        case OP_MATRIX:
+            memcpy(&n_src, msg + MSG_EXT_SZ + 2, sizeof(n_src));
+            // fall through
+        case OP_QUERY:
+        case OP_WQUERY:
+        case OP_TREE:
+            memcpy(&id, msg + MSG_EXT_SZ, sizeof(id));
+            cost = p->need - p->body; // the problem of graph id 0
+            if(id) {
+                cost = (size_t)MSG_REC_SZ
+                     * __atomic_load_n(&resident_edges[id], __ATOMIC_RELAXED);
+            }
+            return cost * n_src;
+        default:
+            return p->need;
+    }
+}
+
+/* Queue the problem of a connection for the solvers
+ *
+ * Requires:
+ *   - c->cost set (see job_cost)
+ *
+ * Guarantees:
+ *   - The problem is queued if the queue is empty, it costs nothing or the
+ *     queued bytes stay within jq->max, and 0 will be returned
+ *   - -1 will be returned otherwise; the connection isn't queued
+ */
+int jobq_push( jobq_t *jq
+             , conn_t *c
+             )
+{
+    int rc = 0;
+
+    c->next = NULL;
+    pthread_mutex_lock(&jq->lock);
+    if(jq->max && c->cost && jq->head && jq->bytes + c->cost > jq->max) {
+        rc = -1;
+    } else {
+        if(jq->tail) jq->tail->next = c;
+        else jq->head = c;
+        jq->tail = c;
+        jq->bytes += c->cost;
+        pthread_cond_signal(&jq->cond);
+    }
+    pthread_mutex_unlock(&jq->lock);
+    return rc;
+}
+
+// Blocks until a problem is available and returns its connection
+conn_t * jobq_pop(jobq_t *jq)
+{
+    conn_t *c = NULL;
+    pthread_mutex_lock(&jq->lock);
+    while(!jq->head) pthread_cond_wait(&jq->cond, &jq->lock);
+    c = jq->head;
+    jq->head = c->next;
+    if(!jq->head) jq->tail = NULL;
+    jq->bytes -= c->cost;
+    pthread_mutex_unlock(&jq->lock);
+    return c;
+}
+
+// Hands a solved connection back to its I/O thread
+void io_complete(conn_t *c)
+{
+    io_thread_t *io = c->io;
+    uint64_t one = 1;
+    pthread_mutex_lock(&io->lock);
+    c->next = io->done;
+    io->done = c;
+    pthread_mutex_unlock(&io->lock);
+    write(io->efd, &one, sizeof(one));
+}
+
+/* Close the connection
+ *
+ * Guarantees:
+ *   - The fd is closed, which also removes it from the epoll set
+ *   - The memory is only released by conn_reap(), since a later event of the
+ *     current epoll batch may still point at the connection
+ */
+void conn_close(conn_t *c)
+{
+    close(c->fd);
+    c->state = CONN_DEAD;
+    c->next = c->io->dead;
+    c->io->dead = c;
+}
+
+// Releases the connections closed during the last epoll batch
+void conn_reap(io_thread_t *io)
+{
+    while(io->dead) {
+        conn_t *c = io->dead;
+        io->dead = c->next;
+        free(c->in.b.p);
+        free(c->out.p);
+        free(c);
+    }
+}
+
+void conn_read(conn_t *c);
+
+// Writes as much of the pending reply as the socket accepts; returns 1 once
+// all of it is written, 0 if the socket is full and -1 if the write fails
+int conn_flush(conn_t *c)
+{
+    while(c->out_off < c->out_len) {
+        ssize_t r = write(c->fd, c->out.p + c->out_off, c->out_len - c->out_off);
+        if(-1 == r && EINTR == errno) continue;
+        if(-1 == r && EAGAIN == errno) return 0;
+        if(r <= 0) return -1;
+        c->out_off += r;
+    }
+    hist_add(&c->io->m.phase[PHASE_WRITE], metrics_now() - c->ready);
+    return 1;
+}
+
+/* Write as much of the pending reply as the socket accepts
+ *
+ * Guarantees:
+ *   - Once the whole reply has been written the connection is closed if the
+ *     session is over, or goes back to reading its next message
+ *   - The connection is closed if the write fails
+ *   - The connection is left as is if the socket is full; the next EPOLLOUT
+ *     edge resumes the write
+ */
+void conn_write(conn_t *c)
+{
+    int rc = conn_flush(c);
+
+    if(0 == rc) return;
+    if(rc < 0 || c->last) {
+        conn_close(c);
+        return;
+    }
+    inbuf_consume(&c->in, &c->p);
+    c->state = CONN_READ;
+    conn_read(c); // the next message may already be buffered
+}
+
+// Makes the busy reply the connection's pending reply; 0 or -1 on allocation
+// failure
+int conn_busy(conn_t *c)
+{
+    bin_reply_t bin = { REPLY_BUSY, 0, 0, 0, 0 };
+    const char *body = BUSY_TEXT;
+    uint32_t len = sizeof(BUSY_TEXT); // legacy replies include the '\0'
+    size_t hdr = 0;
+
+    if((c->ss.flags & SESSION_BINARY) || OP_TREE == c->p.op) {
+        body = (const char *)&bin;
+        len = sizeof(bin);
+    } else if(c->ss.flags & SESSION_FRAMED) {
+        --len;
+    }
+    if(c->ss.flags & SESSION_FRAMED) hdr = sizeof(len);
+    if(0 != buf_reserve(&c->out, hdr + len)) return -1;
+    memcpy(c->out.p, &len, hdr);
+    memcpy(c->out.p + hdr, body, len);
+    c->out_len = hdr + len;
+    c->out_off = 0;
+    c->last = session_done(&c->ss, &c->p);
+    return 0;
+}
+
+/* Parse the buffered bytes of a connection and dispatch a complete message
+ *
+ * Guarantees:
+ *   - CONN_SOLVE will be returned once a complete message is queued for a
+ *     solver, which owns the connection from then on
+ *   - CONN_WRITE will be returned if the job queue refused it; the busy
+ *     reply is pending (see conn_busy)
+ *   - CONN_READ will be returned if more bytes are needed; the receive
+ *     buffer has room for them
+ *   - CONN_DEAD will be returned if the message is malformed or memory ran
+ *     out
+ */
+int conn_parse(conn_t *c)
+{
+    int rc = parse_msg(&c->p, c->in.b.p + c->in.off, c->in.len - c->in.off);
+
+    if(rc > 0) {
+        c->cost = job_cost(&c->p, c->in.b.p + c->in.off);
+        c->state = CONN_SOLVE; // the solver may take it once it's queued
+        if(0 == jobq_push(c->io->jobs, c)) return CONN_SOLVE;
+        metric_add(&c->io->m.busy, 1);
+        c->state = CONN_WRITE;
+        c->ready = metrics_now();
+        return 0 == conn_busy(c) ? CONN_WRITE : CONN_DEAD;
+    }
+    if(rc < 0 || 0 != inbuf_reserve(&c->in, c->p.need)) return CONN_DEAD;
+    return CONN_READ;
+}
+
+/* Drain the socket into the connection and dispatch a complete message
+ *
+ * Guarantees:
+ *   - Buffered bytes are parsed first, then bytes are read until EAGAIN
+ *     (required by edge-triggered epoll) or until the message is complete,
+ *     in which case it is queued for a solver
+ *   - A message the job queue refuses is answered busy (see conn_busy)
+ *     without being solved, and the next one is read
+ *   - Bytes after a complete message stay buffered; they are read again
+ *     once its reply is written, so pipelined messages are served in order
+ *   - A connection closed between or in the middle of messages is dropped
+ */
+void conn_read(conn_t *c)
+{
+    while(CONN_READ == c->state) {
+        ssize_t r = 0;
+        int rc = conn_parse(c);
+        if(CONN_SOLVE == rc) return;
+        if(CONN_WRITE == rc) {
+            if((rc = conn_flush(c)) < 0) break;
+            if(0 == rc) return; // the next EPOLLOUT edge resumes the write
+            if(c->last) break;
+            inbuf_consume(&c->in, &c->p);
+            c->state = CONN_READ;
+            continue;
+        }
+        if(CONN_DEAD == rc) break;
+        r = read(c->fd, c->in.b.p + c->in.len, c->in.b.cap - c->in.len);
+        if(-1 == r && EINTR == errno) continue;
+        if(-1 == r && EAGAIN == errno) return;
+        if(r <= 0) break; // EOF or error
+        if(c->accepted) {
+            hist_add(&c->io->m.phase[PHASE_FIRST_BYTE], metrics_now() - c->accepted);
+            c->accepted = 0;
+        }
+        c->in.len += r;
+    }
+    conn_close(c);
+}
+
+// Accepts every pending client on the I/O thread's listener
+void io_accept(io_thread_t *io)
+{
+    int fd = -1;
+    while(-1 != (fd = accept4(io->fd, NULL, NULL, SOCK_NONBLOCK))) {
+        struct epoll_event ev;
+        conn_t *c = calloc(1, sizeof(*c));
+        if(!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->state = CONN_READ;
+        c->io = io;
+        c->accepted = metrics_now();
+        parse_init(&c->p);
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = c;
+        if(-1 == epoll_ctl(io->ep, EPOLL_CTL_ADD, fd, &ev)) {
+            conn_close(c);
+            continue;
+        }
+        conn_read(c); // data may have arrived before registration
+    }
+}
+
+// Returns the list of connections whose reply is ready, emptying it
+conn_t * io_take_done(io_thread_t *io)
+{
+    conn_t *c = NULL;
+    pthread_mutex_lock(&io->lock);
+    c = io->done;
+    io->done = NULL;
+    pthread_mutex_unlock(&io->lock);
+    return c;
+}
+
+// Starts writing every reply the solvers have finished
+void io_drain_done(io_thread_t *io)
+{
+    uint64_t n = 0;
+    conn_t *c = NULL;
+    read(io->efd, &n, sizeof(n));
+    c = io_take_done(io);
+    while(c) {
+        conn_t *next = c->next;
+        c->state = CONN_WRITE;
+        conn_write(c);
+        c = next;
+    }
+}
+
+/* Runs the epoll loop of an I/O thread
+ *
+ * Requires:
+ *   - An io_thread_t with a non-blocking listener, an epoll set and an eventfd
+ *
+ * Guarantees:
+ *   - Listener, eventfd and client events are dispatched until epoll fails
+ *   - Events for a connection being solved are ignored; it is owned by the
+ *     solver until io_complete()
+ */
+void * io_main(void *arg)
+{
+    io_thread_t *io = arg;
+    struct epoll_event ev[256];
+    int i = 0, n = 0;
+
+    while(-1 != (n = epoll_wait(io->ep, ev, 256, -1)) || EINTR == errno) {
+        for(i = 0; i < n; ++i) {
+            conn_t *c = ev[i].data.ptr;
+            if(NULL == c) io_accept(io);
+            else if((void *)io == (void *)c) io_drain_done(io);
+            else if(CONN_READ == c->state) conn_read(c);
+            else if(CONN_WRITE == c->state) conn_write(c);
+        }
+        conn_reap(io);
+    }
+    fprintf(stderr, "Epoll Error: %s\n", strerror(errno));
+    return NULL;
+}
+
+/* io_uring front end (-U)
+ *
+ * Each pass of an I/O thread hands every operation it queued while taking
+ * the last batch of completions to the kernel in one io_uring_enter, which
+ * also waits for the next batch. A multishot accept takes every client of
+ * the listener, bytes are received straight into the connection's parse
+ * buffer, and a reply that ends its session is sent linked to the close of
+ * its socket. Finished replies are announced by a read of the eventfd on
+ * the ring. A connection has at most one receive, or one send (and its
+ * close), in flight, and is freed once all of them have completed.
+ */
+#define URING_ENTRIES 4096 // submission slots of each I/O thread's ring
+static int use_uring = 0; // I/O threads run io_uring loops (-U)
+
+// Operation of a completion, in the low bits of its user data; the other
+// bits are its connection (NULL for the listener and the eventfd)
+enum { URING_ACCEPT, URING_WAKE, URING_RECV, URING_SEND, URING_CLOSE };
+#define URING_OP_MASK 0x7
+
+// Returns the user data of operation op of connection c
+static inline uint64_t uring_data( const conn_t *c
+                                 , int op
+                                 )
+{
+    return (uintptr_t)c | op;
+}
+
+// Frees a dead connection once none of its operations is in flight; its
+// socket is closed unless a linked close already did
+void ring_release(conn_t *c)
+{
+    if(CONN_DEAD != c->state || 0 != c->pending) return;
+    if(-1 != c->fd) close(c->fd);
+    free(c->in.b.p);
+    free(c->out.p);
+    free(c);
+}
+
+// Drops the connection; nothing more is queued for it
+void ring_close(conn_t *c)
+{
+    c->state = CONN_DEAD;
+    ring_release(c);
+}
+
+void ring_read(conn_t *c);
+
+// Goes back to reading the next message once the whole reply is sent,
+// unless the session is over
+void ring_sent(conn_t *c)
+{
+    hist_add(&c->io->m.phase[PHASE_WRITE], metrics_now() - c->ready);
+    if(c->last) {
+        ring_close(c);
+        return;
+    }
+    inbuf_consume(&c->in, &c->p);
+    c->state = CONN_READ;
+    ring_read(c);
+}
+
+/* Queue the send of the rest of the pending reply
+ *
+ * Guarantees:
+ *   - If the session is over, the send is linked to the close of the socket
+ *   - An empty reply (such as OP_HELLO's, or none for a message that can't
+ *     be answered) is done at once (see ring_sent)
+ *   - A connection whose send can't be queued is dropped
+ */
+void ring_write(conn_t *c)
+{
+    uring_t *r = &c->io->ring;
+    const char *p = c->out.p + c->out_off;
+    size_t n = c->out_len - c->out_off;
+
+    if(0 == n) {
+        ring_sent(c);
+    } else if(!c->last) {
+        if(0 != uring_send(r, c->fd, p, n, uring_data(c, URING_SEND))) {
+            ring_close(c);
+            return;
+        }
+        ++c->pending;
+    } else {
+        if(0 != uring_send_close( r, c->fd, p, n, uring_data(c, URING_SEND)
+                                , uring_data(c, URING_CLOSE))) {
+            ring_close(c);
+            return;
+        }
+        c->pending += 2;
+    }
+}
+
+/* Dispatch the buffered bytes of a connection or queue a receive of more
+ *
+ * Guarantees:
+ *   - As conn_read(), but bytes are received by the ring, one receive at a
+ *     time, so the parse buffer is never moved under one
+ */
+void ring_read(conn_t *c)
+{
+    int rc = conn_parse(c);
+
+    if(CONN_SOLVE == rc) return;
+    if(CONN_WRITE == rc) {
+        ring_write(c);
+        return;
+    }
+    if(CONN_READ == rc && 0 == uring_recv( &c->io->ring, c->fd
+                                         , c->in.b.p + c->in.len
+                                         , c->in.b.cap - c->in.len
+                                         , uring_data(c, URING_RECV))) {
+        ++c->pending;
+        return;
+    }
+    ring_close(c);
+}
+
+/* Handle the completion of an operation of a connection
+ *
+ * Guarantees:
+ *   - Received bytes are dispatched; EOF or an error drops the connection
+ *   - A reply sent in full goes back to reading the next message, unless
+ *     its linked close ends the session; one cut short is sent on
+ *   - A cancelled linked close leaves the socket open for the rest of the
+ *     reply or for ring_release()
+ */
+void ring_complete( conn_t *c
+                  , int op
+                  , int32_t res
+                  )
+{
+    --c->pending;
+    switch(op) {
+        case URING_RECV:
+            if(res <= 0) break; // EOF or error
+            if(c->accepted) {
+                hist_add( &c->io->m.phase[PHASE_FIRST_BYTE]
+                        , metrics_now() - c->accepted);
+                c->accepted = 0;
+            }
+            c->in.len += res;
+            ring_read(c);
+            return;
+        case URING_SEND:
+            if(res <= 0) break;
+            c->out_off += res;
+            if(c->out_off < c->out_len) { // its linked close was cancelled
+                ring_write(c);
+                return;
+            }
+            if(c->last) { // the linked close ends the session
+                hist_add(&c->io->m.phase[PHASE_WRITE], metrics_now() - c->ready);
+                return;
+            }
+            ring_sent(c);
+            return;
+        case URING_CLOSE:
+            if(-ECANCELED == res) {
+                ring_release(c);
+                return;
+            }
+            c->fd = -1; // the fd is released even if close fails
+            break;
+    }
+    ring_close(c);
+}
+
+// Starts serving a client the ring accepted
+void ring_open( io_thread_t *io
+              , int fd
+              )
+{
+    conn_t *c = calloc(1, sizeof(*c));
+    if(!c) {
+        close(fd);
+        return;
+    }
+    c->fd = fd;
+    c->state = CONN_READ;
+    c->io = io;
+    c->accepted = metrics_now();
+    parse_init(&c->p);
+    ring_read(c);
+}
+
+// Starts sending every reply the solvers have finished
+void ring_drain_done(io_thread_t *io)
+{
+    conn_t *c = io_take_done(io);
+    while(c) {
+        conn_t *next = c->next;
+        c->state = CONN_WRITE;
+        ring_write(c);
+        c = next;
+    }
+}
+
+/* Runs the io_uring loop of an I/O thread
+ *
+ * Requires:
+ *   - An io_thread_t whose ring, listener and eventfd io_init() set up
+ *
+ * Guarantees:
+ *   - Completions are dispatched until the ring fails
+ *   - The accept and the eventfd read are queued again whenever they end
+ */
+void * uring_main(void *arg)
+{
+    io_thread_t *io = arg;
+    uring_t *r = &io->ring;
+    uring_cqe_t cqe;
+    int rc = 0;
+
+    rc = uring_accept(r, io->fd, uring_data(NULL, URING_ACCEPT));
+    if(0 == rc) {
+        rc = uring_read( r, io->efd, &io->wake, sizeof(io->wake)
+                       , uring_data(NULL, URING_WAKE));
+    }
+    while(0 == rc && (0 == uring_submit(r, 1) || EINTR == errno
+                   || EAGAIN == errno || EBUSY == errno)) {
+        while(0 == rc && uring_next(r, &cqe)) {
+            conn_t *c = (conn_t *)(uintptr_t)(cqe.data & ~(uint64_t)URING_OP_MASK);
+            int op = cqe.data & URING_OP_MASK;
+            if(URING_ACCEPT == op) {
+                if(cqe.res >= 0) ring_open(io, cqe.res);
+                if(!cqe.more) {
+                    rc = uring_accept(r, io->fd, uring_data(NULL, URING_ACCEPT));
+                }
+            } else if(URING_WAKE == op) {
+                ring_drain_done(io);
+                rc = uring_read( r, io->efd, &io->wake, sizeof(io->wake)
+                               , uring_data(NULL, URING_WAKE));
+            } else {
+                ring_complete(c, op, cqe.res);
+            }
+        }
+    }
+    fprintf(stderr, "Uring Error: %s\n", strerror(errno));
+    return NULL;
+}
+
+/* Sets up an I/O thread's listener, epoll set and eventfd
+ *
+ * Requires:
+ *   - The job queue of its NUMA node and the CPU it will be pinned to (-1
+ *     if none), which its listener is steered to (see listen_steer)
+ *
+ * Guarantees:
+ *   - With -U an io_uring replaces the epoll set, and the listener and
+ *     eventfd stay blocking since the ring waits for them; if the ring
+ *     can't be set up, this and the later I/O threads run epoll
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (and the error is reported on stderr)
+ */
+int io_init( io_thread_t *io
+           , jobq_t *jobs
+           , int cpu
+           , uint16_t port
+           , int backlog
+           )
+{
+    struct epoll_event ev;
+
+    memset(io, 0, sizeof(*io));
+    pthread_mutex_init(&io->lock, NULL);
+    io->jobs = jobs;
+    io->cpu = cpu;
+    io->ring.fd = -1;
+    if(0 != metrics_add(&io->m)) return -1;
+    io->fd = listen_socket(port, backlog);
+    if(-1 == io->fd) return -1;
+    listen_steer(io->fd, cpu);
+    if(use_uring && 0 != uring_init(&io->ring, URING_ENTRIES)) {
+        fprintf(stderr, "Uring Error: %s; using epoll\n", strerror(errno));
+        use_uring = 0;
+    }
+    if(use_uring) {
+        if(-1 == (io->efd = eventfd(0, 0))) {
+            fprintf(stderr, "Eventfd Error: %s\n", strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    io->ep = epoll_create1(0);
+    io->efd = eventfd(0, EFD_NONBLOCK);
+    if(-1 == io->ep || -1 == io->efd
+    || -1 == fcntl(io->fd, F_SETFL, fcntl(io->fd, F_GETFL) | O_NONBLOCK)) {
+        fprintf(stderr, "Epoll Error: %s\n", strerror(errno));
+        return -1;
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // listener
+    if(-1 == epoll_ctl(io->ep, EPOLL_CTL_ADD, io->fd, &ev)) return -1;
+    ev.data.ptr = io; // eventfd
+    if(-1 == epoll_ctl(io->ep, EPOLL_CTL_ADD, io->efd, &ev)) return -1;
+    return 0;
+}
+
+/* Solves problems handed over by the I/O threads
+ *
+ * Requires:
+ *   - A worker_t with initialized scratch space and the job queue shared
+ *     with the I/O threads; its fd is unused
+ *
+ * Guarantees:
+ *   - Each queued message is answered (see serve_msg), the reply is copied
+ *     into the connection and it is passed back to its I/O thread
+ *   - A connection whose message can't be answered is closed
+ */
+void * solver_main(void *arg)
+{
+    worker_t *wk = arg;
+    scratch_t *w = &wk->w;
+
+    for(;;) {
+        conn_t *c = jobq_pop(wk->jobs);
+        reply_t r;
+        size_t hdr = 0, body = 0;
+        c->out_len = c->out_off = 0;
+        c->last = 1;
+        if(0 == serve_msg(w, &c->ss, &c->p, c->in.b.p + c->in.off, &r)
+        && 0 == buf_reserve(&c->out, r.iov[0].iov_len + r.iov[1].iov_len)) {
+            hdr = r.iov[0].iov_len;
+            body = r.iov[1].iov_len;
+            if(hdr) memcpy(c->out.p, r.iov[0].iov_base, hdr);
+            if(body) memcpy(c->out.p + hdr, r.iov[1].iov_base, body);
+            c->out_len = hdr + body;
+            c->last = session_done(&c->ss, &c->p);
+        }
+        c->ready = metrics_now();
+        io_complete(c);
+    }
+    return NULL;
+}
+
+// The stats thread; its fds are -1 when unused
+typedef struct {
+    pthread_t tid;
+    int sfd;             // signalfd of SIGUSR1
+    int fd;              // listener of the -m stats port
+} stats_thread_t;
+
+// Writes all of the len bytes at p to fd; 0 or -1
+int write_all( int fd
+             , const char *p
+             , size_t len
+             )
+{
+    while(len > 0) {
+        ssize_t r = write(fd, p, len);
+        if(-1 == r && EINTR == errno) continue;
+        if(r <= 0) return -1;
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/* Dumps the stats on SIGUSR1 and serves them on the stats port
+ *
+ * Requires:
+ *   - SIGUSR1 blocked in every thread and its signalfd, or a stats listener
+ *
+ * Guarantees:
+ *   - Each SIGUSR1 writes the OP_STATS text (see stats) to stderr
+ *   - Each client of the stats port is sent the same text and closed; it
+ *     needn't send anything, so `nc host port` is enough
+ */
+void * stats_main(void *arg)
+{
+    stats_thread_t *st = arg;
+    struct pollfd pfd[2] = { { st->sfd, POLLIN, 0 }, { st->fd, POLLIN, 0 } };
+    struct signalfd_siginfo si;
+    buf_t b = {0};
+    int i = 0, cli_fd = 0;
+
+    while(-1 != poll(pfd, 2, -1) || EINTR == errno) {
+        for(i = 0; i < 2; ++i) {
+            if(!(pfd[i].revents & POLLIN)) continue;
+            if(0 == i && sizeof(si) != read(st->sfd, &si, sizeof(si))) continue;
+            if(1 == i && -1 == (cli_fd = accept(st->fd, NULL, NULL))) continue;
+            if(NULL == stats(&b)) {
+                fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+            } else {
+                write_all(0 == i ? STDERR_FILENO : cli_fd, b.p, strlen(b.p));
+            }
+            if(1 == i) close(cli_fd);
+        }
+    }
+    fprintf(stderr, "Poll Error: %s\n", strerror(errno));
+    free(b.p);
+    return NULL;
+}
+
+// Creates a thread pinned to the CPU (see numa_attr); 0 or an errno value
+int spawn( pthread_t *tid
+         , int cpu
+         , void *(*fn)(void *)
+         , void *arg
+         )
+{
+    pthread_attr_t a;
+    int rc = numa_attr(&a, cpu);
+
+    if(0 == rc) rc = pthread_create(tid, &a, fn, arg);
+    pthread_attr_destroy(&a);
+    return rc;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-a arity] [-b backlog] [-c cache_mb] "
+                    "[-e io_threads] [-H]\n"
+                    "       [-L landmarks] [-l select] [-g map]... [-m port] "
+                    "[-O order]\n"
+                    "       [-P] [-p port] [-Q queue_mb] [-q queue] [-R] "
+                    "[-r uploads_mb]\n"
+                    "       [-t threads] [-U] [-u upload_kb]\n"
+                    "  -a arity      priority queue heap arity: 2, 4 or 8 "
+                    "(default 2)\n"
+                    "  -b backlog    listen backlog of each listener "
+                    "(default %d)\n"
+                    "  -c cache_mb   cache replies (and trees) of repeated "
+                    "requests in\n"
+                    "                this many MB; 0 disables the cache "
+                    "(default 0)\n"
+                    "  -e io_threads serve clients from this many epoll "
+                    "threads;\n"
+                    "                0 makes each worker block on its own "
+                    "client (default 0)\n"
+                    "  -g map        make the graph of a map or graph file "
+                    "resident;\n"
+                    "                ids are assigned from 1 in the order "
+                    "given\n"
+                    "  -H            build contraction hierarchies for the "
+                    "graphs of\n"
+                    "                later -g options that don't have one\n"
+                    "  -L landmarks  pick this many ALT landmarks (up to %d) "
+                    "for the\n"
+                    "                graphs of later -g options and of "
+                    "uploads with\n"
+                    "                LOAD_ALT (default %u)\n"
+                    "  -l select     how landmarks are picked: farthest or "
+                    "random\n"
+                    "                (default farthest)\n"
+                    "  -m port       also serve the stats (as replied to "
+                    "OP_STATS) to\n"
+                    "                each client of this port; SIGUSR1 "
+                    "dumps them to\n"
+                    "                stderr either way\n"
+                    "  -O order      renumber the vertices of the graphs of "
+                    "later -g\n"
+                    "                options and of uploads with "
+                    "LOAD_REORDER for\n"
+                    "                locality: bfs, rcm, degree or none; "
+                    "requests and\n"
+                    "                replies keep their ids (default: -g "
+                    "graphs none,\n"
+                    "                uploads rcm)\n"
+                    "  -P            pin the threads to CPUs spread over the "
+                    "NUMA nodes;\n"
+                    "                with -e, connections are steered to "
+                    "an I/O thread\n"
+                    "                on the CPU that received them, which "
+                    "hands problems\n"
+                    "                to the solvers of its node\n"
+                    "  -p port       port to listen on (default %d)\n"
+                    "  -Q queue_mb   with -e, answer busy to requests that "
+                    "would leave\n"
+                    "                more than this many MB of edges queued "
+                    "for the\n"
+                    "                solvers (of each node with -P); 0 "
+                    "admits\n"
+                    "                everything (default %d)\n"
+                    "  -q queue      queue of one-directional searches: "
+                    "heap, bucket\n"
+                    "                or auto: bucket if the max edge cost "
+                    "is < %d\n"
+                    "                (default auto)\n"
+                    "  -R            -P, and search a copy of each resident "
+                    "graph made\n"
+                    "                on the node of the thread\n"
+                    "  -r uploads_mb answer busy to uploads (OP_LOAD & "
+                    "OP_WLOAD) once\n"
+                    "                their messages would add up to more "
+                    "than this many\n"
+                    "                MB; 0 admits everything (default 0)\n"
+                    "  -t threads    number of solver threads; the sources "
+                    "of a matrix\n"
+                    "                are spread over as many (default 1)\n"
+                    "  -U            with -e, the I/O threads batch their "
+                    "syscalls on an\n"
+                    "                io_uring: multishot accept, receives "
+                    "into the parse\n"
+                    "                buffers and replies linked to the "
+                    "close; epoll if\n"
+                    "                the kernel lacks io_uring\n"
+                    "  -u upload_kb  refuse an upload whose message is "
+                    "larger than this\n"
+                    "                many KB, closing its connection as "
+                    "malformed; 0\n"
+                    "                admits any size (default 0)\n"
+                    , prog
+                    , SOMAXCONN
+                    , ALT_K_MAX
+                    , ALT_LANDMARKS
+                    , LISTEN_PORT
+                    , QUEUE_MB
+                    , BUCKET_AUTO_MAX
+                    );
+}
+
+int main( int argc
+        , char *argv[]
+        )
+{
+    int opt = 0, i = 0;
+    int arity = 2, backlog = SOMAXCONN, port = LISTEN_PORT, threads = 1;
+    int io_threads = 0, with_ch = 0, queue = QUEUE_AUTO, cache_mb = 0;
+    int mport = 0, queue_mb = QUEUE_MB, pin = 0, lfd = -1;
+    int upload_kb = 0, uploads_mb = 0;
+    uint32_t with_alt = 0; // landmarks of later -g graphs
+    int with_order = ORDER_NONE; // numbering of later -g graphs
+    uint32_t nodes = 1;    // NUMA nodes the threads are spread over
+    worker_t *wk = NULL, *mh = NULL;
+    io_thread_t *io = NULL;
+    stats_thread_t st = { 0, -1, -1 };
+    sigset_t usr1;
+    static numa_t nu;
+    static jobq_t jobs[NUMA_NODE_MAX]; // the solvers' queue of each node
+
+    while(-1 != (opt = getopt(argc, argv, "a:b:c:e:g:HL:l:m:O:Pp:Q:q:Rr:t:Uu:h"))) {
+        uint16_t id = 0;
+        switch(opt) {
+            case 'a': arity = atoi(optarg); break;
+            case 'b': backlog = atoi(optarg); break;
+            case 'c': cache_mb = atoi(optarg); break;
+            case 'e': io_threads = atoi(optarg); break;
+            case 'g':
+                if(0 == (id = resident_load_file(optarg, with_ch, with_alt
+                                                   , with_order))) {
+                    fprintf(stderr, "Map Error: %s\n", optarg);
+                    return 1;
+                }
+                fprintf(stderr, "Graph %d: %s\n", id, optarg);
+                break;
+            case 'H': with_ch = 1; break;
+            case 'L':
+                if(atoi(optarg) < 0 || atoi(optarg) > ALT_K_MAX) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                with_alt = alt_landmarks = atoi(optarg);
+                break;
+            case 'l':
+                if(0 == strcmp(optarg, "farthest")) alt_select = ALT_FARTHEST;
+                else if(0 == strcmp(optarg, "random")) alt_select = ALT_RANDOM;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm': mport = atoi(optarg); break;
+            case 'O':
+                if(0 == strcmp(optarg, "none")) with_order = ORDER_NONE;
+                else if(0 == strcmp(optarg, "bfs")) with_order = ORDER_BFS;
+                else if(0 == strcmp(optarg, "rcm")) with_order = ORDER_RCM;
+                else if(0 == strcmp(optarg, "degree")) with_order = ORDER_DEGREE;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                graph_order = with_order;
+                break;
+            case 'P': pin = 1; break;
+            case 'p': port = atoi(optarg); break;
+            case 'Q': queue_mb = atoi(optarg); break;
+            case 'q':
+                if(0 == strcmp(optarg, "auto")) queue = QUEUE_AUTO;
+                else if(0 == strcmp(optarg, "heap")) queue = QUEUE_HEAP;
+                else if(0 == strcmp(optarg, "bucket")) queue = QUEUE_BUCKET;
+                else queue = -1;
+                break;
+            case 'R': pin = replicate = 1; break;
+            case 'r': uploads_mb = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'U': use_uring = 1; break;
+            case 'u': upload_kb = atoi(optarg); break;
+            default: usage(argv[0]); return 'h' == opt ? 0 : 1;
+        }
+    }
+    if((2 != arity && 4 != arity && 8 != arity)
+    || backlog < 1 || port < 1 || port > 65535 || threads < 1
+    || io_threads < 0 || queue < 0 || cache_mb < 0
+    || mport < 0 || mport > 65535 || queue_mb < 0
+    || upload_kb < 0 || uploads_mb < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    upload_max = (size_t)upload_kb << 10;
+    uploads_max = (size_t)uploads_mb << 20;
+    signal(SIGPIPE, SIG_IGN); // a vanished client must not kill the server
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1); // only the stats thread takes it, via signalfd
+    errno = pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+    if(0 != errno || -1 == (st.sfd = signalfd(-1, &usr1, 0))) {
+        fprintf(stderr, "Signal Error: %s\n", strerror(errno));
+        return 1;
+    }
+    if(mport && -1 == (st.fd = listen_socket(mport, backlog))) return 1;
+    relax_init();
+    if(0 != cache_init((size_t)cache_mb << 20)) {
+        fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+        return 1;
+    }
+
+    wk = calloc(threads, sizeof(*wk));
+    mh = calloc(threads, sizeof(*mh));
+    io = calloc(io_threads + 1, sizeof(*io));
+    if(!wk || !mh || !io) {
+        fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+        return 1;
+    }
+    if(pin && 0 != numa_init(&nu)) {
+        fprintf(stderr, "Affinity Error: %s\n", strerror(errno));
+        return 1;
+    }
+    // Worker i, I/O thread i and matrix helper i run on node i % nodes, so
+    // every node with an I/O thread has a solver
+    if(pin) nodes = nu.n_node;
+    if(nodes > (uint32_t)threads) nodes = threads;
+    for(i = 0; i < (int)nodes; ++i) {
+        pthread_mutex_init(&jobs[i].lock, NULL);
+        pthread_cond_init(&jobs[i].cond, NULL);
+        jobs[i].max = (size_t)queue_mb << 20;
+    }
+    // Blocking workers share one listener: with one each, reuseport would
+    // hash new clients to a worker busy with a framed session for good
+    if(0 == io_threads && -1 == (lfd = listen_socket(port, backlog))) return 1;
+    for(i = 0; i < threads; ++i) {
+        wk[i].fd = lfd;
+        wk[i].cpu = pin ? numa_cpu(&nu, i % nodes) : -1;
+        wk[i].jobs = &jobs[i % nodes];
+        if(0 != scratch_init(&wk[i].w, arity, queue)
+        || 0 != reader_add(&wk[i].w) || 0 != metrics_add(&wk[i].w.m)) {
+            fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+            return 1;
+        }
+        wk[i].w.node = i % nodes;
+    }
+    for(i = 0; i < io_threads; ++i) {
+        int cpu = pin ? numa_cpu(&nu, i % nodes) : -1;
+        if(0 != io_init(&io[i], &jobs[i % nodes], cpu, port, backlog)) return 1;
+    }
+    matrix_helpers = threads - 1; // with the worker of a matrix, -t threads
+    build_threads = threads;
+    for(i = 0; i < matrix_helpers; ++i) {
+        if(0 != scratch_init(&mh[i].w, arity, queue)
+        || 0 != reader_add(&mh[i].w) || 0 != metrics_add(&mh[i].w.m)) {
+            fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+            return 1;
+        }
+        mh[i].w.node = i % nodes;
+        mh[i].cpu = pin ? numa_cpu(&nu, i % nodes) : -1;
+        errno = spawn(&mh[i].tid, mh[i].cpu, matrix_main, &mh[i].w);
+        if(0 != errno) {
+            fprintf(stderr, "Thread Error: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    for(i = 0; i < threads; ++i) {
+        errno = spawn( &wk[i].tid
+                     , wk[i].cpu
+                     , io_threads ? solver_main : worker_main
+                     , &wk[i]
+                     );
+        if(0 != errno) {
+            fprintf(stderr, "Thread Error: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    for(i = 0; i < io_threads; ++i) {
+        errno = spawn( &io[i].tid
+                     , io[i].cpu
+                     , -1 != io[i].ring.fd ? uring_main : io_main
+                     , &io[i]
+                     );
+        if(0 != errno) {
+            fprintf(stderr, "Thread Error: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    errno = pthread_create(&st.tid, NULL, stats_main, &st);
+    if(0 != errno) {
+        fprintf(stderr, "Thread Error: %s\n", strerror(errno));
+        return 1;
+    }
+    for(i = 0; i < io_threads; ++i) pthread_join(io[i].tid, NULL);
+    if(0 == io_threads) {
+        for(i = 0; i < threads; ++i) {
+            pthread_join(wk[i].tid, NULL);
+            reader_remove(&wk[i].w);
+            metrics_remove(&wk[i].w.m);
+            scratch_destroy(&wk[i].w);
+        }
+        close(lfd);
     }
+    free(io);
+    free(wk);
+    free(mh);
     return 0;
 }
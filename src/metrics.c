@@ -0,0 +1,164 @@
+/* Runtime Metrics for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+static metrics_t **reg = NULL;  // registered metrics
+static uint32_t n_reg = 0, reg_cap = 0;
+static metrics_t gone;          // sum of the metrics removed
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *algo_name[METRICS_ALGO_N] = { "dijkstra", "bidir", "ch", "alt" };
+static const char *phase_name[PHASE_N] = { "first_byte", "load", "search"
+                                         , "path", "write", "build" };
+
+// Adds the metrics of a thread to the sum; every field is a uint64_t, so
+// they are summed as an array
+static void metrics_sum( metrics_t *to
+                       , const metrics_t *m
+                       )
+{
+    const uint64_t *s = (const uint64_t *)m;
+    uint64_t *d = (uint64_t *)to;
+    size_t i = 0;
+
+    for(i = 0; i < sizeof(*m) / sizeof(*s); ++i) {
+        d[i] += __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Returns the largest value bucket b holds
+static uint64_t hist_top(uint32_t b)
+{
+    uint32_t e = 0;
+    if(b < HIST_SUB) return b;
+    e = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    return ((uint64_t)(HIST_SUB + (b & (HIST_SUB - 1))) << (e - HIST_SUB_BITS))
+         + ((uint64_t)1 << (e - HIST_SUB_BITS)) - 1;
+}
+
+// Returns the value at quantile q of the histogram; 0 if it is empty
+static uint64_t hist_quantile( const hist_t *h
+                             , double q
+                             )
+{
+    uint64_t rank = (uint64_t)(q * h->count + 0.5), seen = 0;
+    uint32_t b = 0;
+
+    if(0 == h->count) return 0;
+    if(rank < 1) rank = 1;
+    for(b = 0; b < HIST_N; ++b) {
+        seen += h->n[b];
+        if(seen >= rank) return hist_top(b);
+    }
+    return hist_top(HIST_N - 1);
+}
+
+int metrics_add(metrics_t *m)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&reg_lock);
+    if(n_reg == reg_cap) {
+        uint32_t cap = reg_cap ? reg_cap * 2 : 16;
+        metrics_t **r = realloc(reg, sizeof(*r) * cap);
+        if(r) {
+            reg = r;
+            reg_cap = cap;
+        }
+    }
+    if(n_reg < reg_cap) reg[n_reg++] = m;
+    else rc = -1;
+    pthread_mutex_unlock(&reg_lock);
+    return rc;
+}
+
+void metrics_remove(metrics_t *m)
+{
+    uint32_t i = 0;
+
+    pthread_mutex_lock(&reg_lock);
+    for(i = 0; i < n_reg; ++i) {
+        if(reg[i] == m) {
+            metrics_sum(&gone, m);
+            reg[i] = reg[--n_reg];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reg_lock);
+}
+
+size_t metrics_format( char *out
+                     , size_t cap
+                     )
+{
+    metrics_t t;
+    size_t len = 0;
+    uint32_t i = 0;
+
+    pthread_mutex_lock(&reg_lock);
+    memcpy(&t, &gone, sizeof(t));
+    for(i = 0; i < n_reg; ++i) metrics_sum(&t, reg[i]);
+    pthread_mutex_unlock(&reg_lock);
+
+#define OUT(...) \
+    do { if(len < cap) len += snprintf(out + len, cap - len, __VA_ARGS__); } while(0)
+    OUT("requests %llu\nerrors %llu\nbusy %llu\n"
+       , (unsigned long long)t.requests
+       , (unsigned long long)t.errors
+       , (unsigned long long)t.busy
+       );
+    for(i = 0; i < METRICS_ALGO_N; ++i) { // settled / searches: work per search
+        OUT("searches_%s %llu\nsettled_%s %llu\n"
+           , algo_name[i]
+           , (unsigned long long)t.searches[i]
+           , algo_name[i]
+           , (unsigned long long)t.settled[i]
+           );
+    }
+    OUT("edges_scanned %llu\nqueue_ops %llu\n"
+       , (unsigned long long)t.edges
+       , (unsigned long long)t.queue_ops
+       );
+    for(i = 0; i < PHASE_N; ++i) {
+        const hist_t *h = &t.phase[i];
+        uint32_t top = HIST_N;
+        while(top > 0 && 0 == h->n[top-1]) --top;
+        OUT("%s_count %llu\n%s_ns_mean %llu\n%s_ns_p50 %llu\n%s_ns_p99 %llu\n"
+            "%s_ns_p999 %llu\n%s_ns_max %llu\n"
+           , phase_name[i], (unsigned long long)h->count
+           , phase_name[i], (unsigned long long)(h->count ? h->sum / h->count : 0)
+           , phase_name[i], (unsigned long long)hist_quantile(h, 0.5)
+           , phase_name[i], (unsigned long long)hist_quantile(h, 0.99)
+           , phase_name[i], (unsigned long long)hist_quantile(h, 0.999)
+           , phase_name[i], (unsigned long long)(top ? hist_top(top - 1) : 0)
+           );
+    }
+#undef OUT
+    return len < cap ? len : cap - 1;
+}
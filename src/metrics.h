@@ -0,0 +1,136 @@
+/* Runtime Metrics for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Counters and latency histograms of one thread. Only the owning thread
+ * writes its metrics, with relaxed stores (metric_add, hist_add), so
+ * recording costs no locked instruction and no shared cache line; readers
+ * sum the metrics of every registered thread (metrics_format).
+ *
+ * Histograms are log-linear like HdrHistogram: each power of 2 is split
+ * into HIST_SUB linear buckets, so a quantile read from a bucket is within
+ * 1/HIST_SUB of the values recorded in it, from nanoseconds to hours
+ */
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_N ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS) // any uint64_t
+#define METRICS_ALGO_N 4 // ALGO_N of solver.h
+#define METRICS_FORMAT_MAX 4096 // bytes metrics_format() may write
+
+// Request phases timed
+enum {
+    PHASE_FIRST_BYTE = 0, // accept to the first byte of the connection
+    PHASE_LOAD = 1,       // load_map (or load_wmap) of a problem
+    PHASE_SEARCH = 2,     // the search of solve (or wsolve)
+    PHASE_PATH = 3,       // gen_path (or wgen_path) of its reply
+    PHASE_WRITE = 4,      // the reply is ready to its last byte written
+    PHASE_BUILD = 5,      // the reverse, order, hierarchy & landmarks of an
+                          // uploaded graph
+    PHASE_N
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;        // nanoseconds
+    uint64_t n[HIST_N];  // values recorded in each bucket
+} hist_t;
+
+typedef struct {
+    uint64_t requests;                  // messages served
+    uint64_t errors;                    // messages that couldn't be answered
+    uint64_t busy;                      // messages refused by admission
+    uint64_t searches[METRICS_ALGO_N];  // searches solve() ran, by ALGO_*
+    uint64_t settled[METRICS_ALGO_N];   // vertices they settled
+    uint64_t edges;                     // edges scanned from those vertices
+    uint64_t queue_ops;                 // their pushes, pops & decrease-keys
+    hist_t phase[PHASE_N];              // nanoseconds of each PHASE_*
+} metrics_t;
+
+// Returns the monotonic time in nanoseconds
+static inline uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Adds n to a counter of the calling thread's metrics
+static inline void metric_add( uint64_t *c
+                             , uint64_t n
+                             )
+{
+    __atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
+
+// Returns the histogram bucket of value x
+static inline uint32_t hist_bucket(uint64_t x)
+{
+    uint32_t e = 0;
+    if(x < HIST_SUB) return x;
+    e = 63 - __builtin_clzll(x); // x is in [2^e, 2^(e+1))
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+         + ((x >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// Records ns nanoseconds in a histogram of the calling thread's metrics
+static inline void hist_add( hist_t *h
+                           , uint64_t ns
+                           )
+{
+    metric_add(&h->n[hist_bucket(ns)], 1);
+    metric_add(&h->count, 1);
+    metric_add(&h->sum, ns);
+}
+
+/* Register a thread's metrics
+ *
+ * Guarantees:
+ *   - The metrics are summed by metrics_format() until metrics_remove()
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the registry can't grow
+ */
+int metrics_add(metrics_t *m);
+
+// Unregisters the metrics, if they were registered; their counts are kept
+// in the totals
+void metrics_remove(metrics_t *m);
+
+/* Format the sum of every thread's metrics
+ *
+ * Guarantees:
+ *   - One "name value" line per counter, then the count, mean, p50, p99,
+ *     p999 and max (in nanoseconds) of each phase
+ *   - At most cap bytes are written, including the '\0'; the length of the
+ *     text will be returned
+ */
+size_t metrics_format( char *out
+                     , size_t cap
+                     );
+
+#endif // METRICS_H
@@ -0,0 +1,101 @@
+/* NUMA Placement for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numa.h"
+
+// Adds the CPUs of a sysfs cpulist ("0-3,8,10-11") to the set
+static void cpulist_parse( const char *s
+                         , cpu_set_t *set
+                         )
+{
+    char *end = NULL;
+
+    while(*s) {
+        long lo = strtol(s, &end, 10), hi = lo;
+        if(end == s) break;
+        if('-' == *end) hi = strtol(end + 1, &end, 10);
+        for(; lo <= hi && lo < CPU_SETSIZE; ++lo) CPU_SET(lo, set);
+        s = ',' == *end ? end + 1 : end;
+    }
+}
+
+int numa_init(numa_t *nu)
+{
+    cpu_set_t usable;
+    char path[64], line[4096];
+    int id = 0;
+
+    memset(nu, 0, sizeof(*nu));
+    if(0 != sched_getaffinity(0, sizeof(usable), &usable)) return -1;
+    for(id = 0; id < 1024 && nu->n_node < NUMA_NODE_MAX; ++id) {
+        cpu_set_t *set = &nu->cpus[nu->n_node];
+        FILE *f = NULL;
+        snprintf( path, sizeof(path), "/sys/devices/system/node/node%d/cpulist"
+                , id);
+        if(!(f = fopen(path, "r"))) continue; // node ids may have holes
+        CPU_ZERO(set);
+        if(fgets(line, sizeof(line), f)) cpulist_parse(line, set);
+        fclose(f);
+        CPU_AND(set, set, &usable);
+        if(CPU_COUNT(set) > 0) nu->next[nu->n_node++] = -1;
+    }
+    if(0 == nu->n_node) {
+        nu->cpus[0] = usable;
+        nu->next[0] = -1;
+        nu->n_node = 1;
+    }
+    return 0;
+}
+
+int numa_cpu( numa_t *nu
+            , uint32_t n
+            )
+{
+    const cpu_set_t *set = &nu->cpus[n % nu->n_node];
+    int *next = &nu->next[n % nu->n_node];
+    int i = 0;
+
+    for(i = 1; i <= CPU_SETSIZE; ++i) {
+        int cpu = (*next + i) % CPU_SETSIZE;
+        if(CPU_ISSET(cpu, set)) return *next = cpu;
+    }
+    return -1; // unreachable; every node has a CPU
+}
+
+int numa_attr( pthread_attr_t *a
+             , int cpu
+             )
+{
+    cpu_set_t set;
+    int rc = pthread_attr_init(a);
+
+    if(0 != rc || -1 == cpu) return rc;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_attr_setaffinity_np(a, sizeof(set), &set);
+}
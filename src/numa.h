@@ -0,0 +1,72 @@
+/* NUMA Placement for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+/* The NUMA nodes the process may run on and their CPUs, read from sysfs so
+ * no NUMA library is needed. Nodes are numbered 0 .. n_node-1 in the order
+ * of their kernel ids, skipping nodes without a CPU the process may use
+ * (sched_getaffinity); without sysfs node entries the usable CPUs are one
+ * node. Threads are pinned to CPUs handed out round robin on each node, and
+ * memory they first touch is then allocated on their node by the kernel
+ */
+#define NUMA_NODE_MAX 64
+
+typedef struct {
+    uint32_t n_node;
+    cpu_set_t cpus[NUMA_NODE_MAX]; // usable CPUs of each node
+    int next[NUMA_NODE_MAX];       // CPU numa_cpu() last handed out on each
+} numa_t;
+
+/* Read the topology
+ *
+ * Guarantees:
+ *   - At least one node with at least one CPU
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the usable CPUs can't be read
+ */
+int numa_init(numa_t *nu);
+
+// Returns the next CPU of node n (modulo n_node), round robin over its CPUs
+int numa_cpu( numa_t *nu
+            , uint32_t n
+            );
+
+/* Make the attributes of a thread to create on a CPU
+ *
+ * Guarantees:
+ *   - The attributes are initialized; they pin the thread to the CPU unless
+ *     it is -1
+ *   - 0 will be returned on success
+ *   - an errno value will be returned on error, like pthread calls
+ */
+int numa_attr( pthread_attr_t *a
+             , int cpu
+             );
+
+#endif // NUMA_H
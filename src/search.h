@@ -0,0 +1,600 @@
+/* Width-specialised Search Code for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* This file is a template, so it has no include guard. It is included once
+ * per width, after defining
+ *   SEARCH_VID   vertex id type; also heap slots and queue indices
+ *   SEARCH_COST  edge cost type
+ *   SEARCH_DIST  distance type
+ *   SEARCH(x)    the name of x at this width
+ * and optionally
+ *   SEARCH_RELAX8 a pointer to a relax8_fn filter of 8 edges, or NULL (see
+ *                 relax_range); searches are scalar without it
+ * and the macros are undefined at the end. solver.h instantiates the compact
+ * width (16-bit ids & costs, 32-bit distances) under the plain names and the
+ * wide width (32-bit ids & costs, 64-bit distances) with a w prefix; the
+ * functions are static inline, so each file including solver.h has them.
+ *
+ * A CSR graph here is n_vert+1 offsets into dest/cost: the outbound edges of
+ * vertex i are dest[off[i]] .. dest[off[i+1]-1]. Edge records are 3 ids
+ * (source, sync & cost) of SEARCH_VID size with no alignment requirement
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef SEARCH_DEC // width-independent helpers, defined once
+#define SEARCH_DEC
+
+// Returns the number of decimal digits of x
+static inline uint32_t dec_len(uint64_t x)
+{
+    uint32_t n = 1;
+    while(x >= 10) { x /= 10; ++n; }
+    return n;
+}
+
+// Writes the decimal digits of x so they end just before out; returns the
+// first digit
+static inline char * dec_put( char *out
+                            , uint64_t x
+                            )
+{
+    do { *--out = '0' + x % 10; x /= 10; } while(x);
+    return out;
+}
+
+// Operations of a priority queue since they were last cleared; summed into
+// the metrics of each search (see solve)
+typedef struct {
+    uint32_t pushes; // entries queued
+    uint32_t pops;   // entries popped (vertices settled)
+    uint32_t decs;   // decrease-keys of queued entries
+    uint32_t edges;  // edges scanned from the vertices settled
+} qstat_t;
+
+#endif // SEARCH_DEC
+
+// A vertex id of 0 is invalid. Therefore, 0 is used as NULL or empty. A
+// relaxation reads and writes every field of its target, so they share one
+// record (widest first: 16 bytes compact, 24 wide) rather than an array each
+typedef struct {
+    // Traversal metadata; only valid when epoch matches the scratch epoch
+    SEARCH_DIST dist; // current shortest distance to vertex
+    uint32_t epoch;   // request generation that last touched this vertex
+    SEARCH_VID prev;  // last vertex in shortest path here
+    SEARCH_VID q_idx; // queue index; used by push/pop & heapify-{up,down}
+    char visited;     // vertex has been visited or not
+} SEARCH(vertex_t);
+
+// Heap entry: a queued vertex and a copy of its dist, so sifting compares
+// the entries themselves instead of chasing each index into the vertices
+typedef struct {
+    SEARCH_DIST dist; // v's dist; kept equal by push and decrease
+    SEARCH_VID v;     // vertex index
+} SEARCH(slot_t);
+
+// Min d-ary heap of vertices ordered by their dist. The root is q[1] and
+// the children of i are q[((i-1) << shift) + 2] onward, so a binary heap
+// (shift 1) keeps the classic 2i, 2i+1 layout
+typedef struct {
+    SEARCH(slot_t) *q; // one slot per vertex; only 1..size are live
+    uint32_t size;     // number of live entries
+    uint32_t shift;    // log2 of the arity (1: binary, 2: 4-ary, 3: 8-ary)
+    qstat_t st;        // operations since last cleared
+} SEARCH(heap_t);
+
+// Returns v[i] after resetting it if an earlier request last touched it
+static inline SEARCH(vertex_t) * SEARCH(touch_v)( SEARCH(vertex_t) *v
+                                                , uint32_t epoch
+                                                , SEARCH_VID i
+                                                )
+{
+    SEARCH(vertex_t) *x = &v[i];
+    if(x->epoch != epoch) {
+        x->epoch = epoch;
+        x->dist = 0;
+        x->visited = 0;
+        x->prev = 0;
+        x->q_idx = 0;
+    }
+    return x;
+}
+
+// Returns 1 if a < b (0 is treated as infinity); otherwise, returns 0
+static inline int SEARCH(lt)( SEARCH_DIST a
+                            , SEARCH_DIST b
+                            )
+{
+    // a != infinity and ( a < b or b == infinity)
+    if(a != 0 && (a < b || b == 0)) return 1;
+    return 0;
+}
+
+// Returns 1 if a > b (0 is treated as infinity); otherwise, returns 0
+static inline int SEARCH(gt)( SEARCH_DIST a
+                            , SEARCH_DIST b
+                            )
+{
+    // b != infinity and (a > b or a == infinity)
+    if(b != 0 && (a > b || a == 0)) return 1;
+    return 0;
+}
+
+/* Should be used to set the value of any position in the queue
+ *
+ * Requires:
+ *   - A valid min heap is provided
+ *     - The entries of the heap index into an array of vertices
+ *   - An array of vertices is provided
+ *   - The queue index to set
+ *   - The entry to set the queue index to
+ *
+ * Guarantees:
+ *   - The entry at the queue index will be set
+ *   - The q_idx of the entry's vertex will be set to the queue index
+ */
+static inline void SEARCH(q_set)( SEARCH(vertex_t) *v
+                                , SEARCH(heap_t) *h
+                                , uint32_t q_i
+                                , SEARCH(slot_t) x
+                                )
+{
+    h->q[q_i] = x;
+    v[x.v].q_idx = q_i;
+}
+
+/* Heapify-up the element in the queue at the provided index
+ *
+ * Requires:
+ *   - A valid min heap is provided
+ *     - The entries of the heap index into an array of vertices
+ *     - 0 dist indicates infinity
+ *   - An array of vertices is provided
+ *   - The head of the heap starts at index 1
+ *
+ * Guarantees:
+ *   - Only the entries are compared; the vertices are only written the
+ *     q_idx of each entry moved
+ *   - The value at the provided index will be heapify-up'd
+ *   - The heap will still be a valid min heap
+ *   - The new index for the value at the provided index will be returned
+ */
+static inline uint32_t SEARCH(heapify_up)( SEARCH(vertex_t) *v
+                                         , SEARCH(heap_t) *h
+                                         , uint32_t i
+                                         )
+{
+    SEARCH(slot_t) x = h->q[i];
+
+    while(i > 1) {
+        uint32_t p = ((i - 2) >> h->shift) + 1;
+        // parent <= child
+        if(!SEARCH(lt)(x.dist, h->q[p].dist)) break;
+        SEARCH(q_set)(v, h, i, h->q[p]); // the parent moves down
+        i = p;
+    }
+    SEARCH(q_set)(v, h, i, x);
+    return i;
+}
+
+/* Heapify-down the element in the queue at the provided index
+ *
+ * Requires:
+ *   - A valid min heap is provided
+ *     - The entries of the heap index into an array of vertices
+ *     - 0 dist indicates infinity
+ *   - An array of vertices is provided
+ *   - The head of the heap starts at index 1
+ *
+ * Guarantees:
+ *   - Only live entries (1..size) are compared, and only the entries; the
+ *     vertices are only written the q_idx of each entry moved
+ *   - The value at the provided index will be heapify-down'd
+ *   - The heap will still be a valid min heap
+ *   - The new index for the value at the provided index will be returned
+ */
+static inline uint32_t SEARCH(heapify_down)( SEARCH(vertex_t) *v
+                                           , SEARCH(heap_t) *h
+                                           , uint32_t i
+                                           )
+{
+    SEARCH(slot_t) x = h->q[i];
+
+    for(;;) {
+        uint32_t c = ((i - 1) << h->shift) + 2; // first child
+        uint32_t c_end = c + (1u << h->shift);
+        uint32_t s = c;
+        if(c > h->size) break; // reached bottom
+        if(c_end > h->size + 1) c_end = h->size + 1;
+        for(++c; c < c_end; ++c) { // child with shortest distance
+            if(SEARCH(lt)(h->q[c].dist, h->q[s].dist)) s = c;
+        }
+        if(!SEARCH(lt)(h->q[s].dist, x.dist)) break; // parent <= children
+        SEARCH(q_set)(v, h, i, h->q[s]); // the child moves up
+        i = s;
+    }
+    SEARCH(q_set)(v, h, i, x);
+    return i;
+}
+
+/* Push the provided index into the min heap
+ *
+ * Requires:
+ *   - A valid min heap is provided
+ *     - The entries of the heap index into an array of vertices
+ *   - An array of vertices is provided with an accessible .dist member
+ *     - 0 dist indicates infinity
+ *   - The index to insert is provided and is not already in the heap
+ *
+ * Guarantees:
+ *   - The new index will be inserted into the min heap with its dist
+ *   - The heap will still be a valid min heap
+ *   - The heap size will be updated
+ */
+static inline void SEARCH(push)( SEARCH(vertex_t) *v
+                               , SEARCH(heap_t) *h
+                               , SEARCH_VID new
+                               )
+{
+    // Add the element to the bottom level of the heap.
+    h->q[++h->size] = (SEARCH(slot_t)){ v[new].dist, new };
+    SEARCH(heapify_up)(v, h, h->size);
+    ++h->st.pushes;
+}
+
+// Moves the queued index i up the heap after its distance decreased
+static inline void SEARCH(decrease)( SEARCH(vertex_t) *v
+                                   , SEARCH(heap_t) *h
+                                   , SEARCH_VID i
+                                   )
+{
+    h->q[v[i].q_idx].dist = v[i].dist;
+    SEARCH(heapify_up)(v, h, v[i].q_idx);
+    ++h->st.decs;
+}
+
+/* Pop the top of the min heap
+ *
+ * Requires:
+ *   - A valid, non-empty min heap is provided
+ *     - The entries of the heap index into an array of vertices
+ *     - 0 dist indicates infinity
+ *   - A vertices array is provided
+ *
+ * Guarantees:
+ *   - The index at the root of the heap will be removed and returned
+ *   - The removed vertex will have it's q_idx cleared
+ *   - The heap will still be a valid min heap
+ *   - The heap size will be updated
+ */
+static inline SEARCH_VID SEARCH(pop)( SEARCH(vertex_t) *v
+                                    , SEARCH(heap_t) *h
+                                    )
+{
+    SEARCH_VID top = h->q[1].v;
+
+    // Replace the root of the heap with the last element on the last level
+    if(h->size > 1) h->q[1] = h->q[h->size];
+    --h->size;
+    ++h->st.pops;
+    v[top].q_idx = 0;
+    if(h->size > 0) SEARCH(heapify_down)(v, h, 1);
+    return top;
+}
+
+// Returns field f (0: source, 1: sync, 2: cost) of edge record i
+static inline SEARCH_VID SEARCH(rec_get)( const char *rec
+                                        , uint32_t i
+                                        , uint32_t f
+                                        )
+{
+    SEARCH_VID x = 0;
+    memcpy(&x, rec + ((size_t)i * 3 + f) * sizeof(x), sizeof(x));
+    return x;
+}
+
+/* Size the CSR graph of n edge records
+ *
+ * Guarantees:
+ *   - n_vert is 1 + the largest source and n_ids 1 + the largest id of
+ *     either end (so n_ids vertices cover every edge)
+ *   - Records naming vertex 0 (the invalid index) are not counted
+ */
+static inline void SEARCH(csr_count)( const char *rec
+                                    , uint32_t n
+                                    , uint64_t *n_vert
+                                    , uint64_t *n_ids
+                                    , uint32_t *n_edge
+                                    )
+{
+    uint32_t i = 0;
+
+    *n_vert = *n_ids = 0;
+    *n_edge = 0;
+    for(i = 0; i < n; ++i) {
+        SEARCH_VID a = SEARCH(rec_get)(rec, i, 0), b = SEARCH(rec_get)(rec, i, 1);
+        if(0 == a || 0 == b) continue;
+        if(a >= *n_vert) *n_vert = (uint64_t)a + 1;
+        if(b >= *n_ids) *n_ids = (uint64_t)b + 1;
+        ++*n_edge;
+    }
+    if(*n_vert > *n_ids) *n_ids = *n_vert;
+}
+
+/* Lay n edge records out in CSR arrays sized by csr_count()
+ *
+ * Guarantees:
+ *   - Out-degrees are counted, prefix-summed into off, and the (dest, cost)
+ *     pairs are scattered into their arrays
+ *   - Edges of a vertex keep the order they had in the records
+ *   - Records naming vertex 0 (the invalid index) are dropped
+ *   - The largest cost of the edges kept will be returned
+ */
+static inline SEARCH_COST SEARCH(csr_scatter)( const char *rec
+                                             , uint32_t n
+                                             , uint32_t n_vert
+                                             , uint32_t *off
+                                             , SEARCH_VID *dest
+                                             , SEARCH_COST *cost
+                                             )
+{
+    SEARCH_COST max_cost = 0;
+    uint32_t i = 0;
+
+    memset(off, 0, sizeof(*off) * ((size_t)n_vert + 1));
+    for(i = 0; i < n; ++i) { // out-degree histogram
+        SEARCH_VID a = SEARCH(rec_get)(rec, i, 0), b = SEARCH(rec_get)(rec, i, 1);
+        if(0 == a || 0 == b) continue;
+        ++off[a + 1];
+    }
+    for(i = 1; i <= n_vert; ++i) off[i] += off[i-1]; // prefix sum
+    for(i = 0; i < n; ++i) { // scatter; off[v] walks to the start of v+1
+        SEARCH_VID a = SEARCH(rec_get)(rec, i, 0), b = SEARCH(rec_get)(rec, i, 1);
+        uint32_t k = 0;
+        if(0 == a || 0 == b) continue;
+        k = off[a]++;
+        dest[k] = b;
+        cost[k] = SEARCH(rec_get)(rec, i, 2);
+        if(cost[k] > max_cost) max_cost = cost[k];
+    }
+    for(i = n_vert; i > 0; --i) off[i] = off[i-1]; // shift back
+    off[0] = 0;
+    return max_cost;
+}
+
+// Relaxes the edge of cost c from the settled vertex s to d
+static inline void SEARCH(relax)( SEARCH(vertex_t) *v
+                                , SEARCH(heap_t) *h
+                                , uint32_t epoch
+                                , SEARCH_VID s
+                                , SEARCH_VID d
+                                , SEARCH_COST c
+                                )
+{
+    SEARCH_DIST cur = SEARCH(touch_v)(v, epoch, d)->dist;
+    SEARCH_DIST dist = v[s].dist + c;
+    // 0 distance represents infinity
+    if(0 == v[d].visited && (0 == cur || dist < cur)) {
+        v[d].dist = dist;
+        v[d].prev = s;
+        if(0 == v[d].q_idx) SEARCH(push)(v, h, d); // add
+        else SEARCH(decrease)(v, h, d); // update location
+    }
+}
+
+/* Relax the outbound edges k .. k_end-1 of the settled vertex s
+ *
+ * Guarantees:
+ *   - Every unvisited target an edge improves gets the new distance & prev,
+ *     and is pushed or moved up the heap
+ *   - With SEARCH_RELAX8 set, runs of 8 edges are first filtered by it: it
+ *     returns a bitmask of the edges whose target may improve, from the
+ *     distances before the run, and only those are relaxed. Targets only
+ *     get closer during a run, so an edge filtered out can't improve
+ */
+static inline void SEARCH(relax_range)( SEARCH(vertex_t) *v
+                                      , SEARCH(heap_t) *h
+                                      , uint32_t epoch
+                                      , SEARCH_VID s
+                                      , const SEARCH_VID *dest
+                                      , const SEARCH_COST *cost
+                                      , uint32_t k
+                                      , uint32_t k_end
+                                      )
+{
+    h->st.edges += k_end - k;
+#ifdef SEARCH_RELAX8
+    if(SEARCH_RELAX8) { // high degree vertices are filtered 8 edges at once
+        for(; k + 8 <= k_end; k += 8) {
+            uint32_t m = SEARCH_RELAX8(v, epoch, v[s].dist, dest + k, cost + k);
+            for(; m; m &= m - 1) {
+                uint32_t j = k + __builtin_ctz(m);
+                SEARCH(relax)(v, h, epoch, s, dest[j], cost[j]);
+            }
+        }
+    }
+#endif
+    for(; k < k_end; ++k) SEARCH(relax)(v, h, epoch, s, dest[k], cost[k]);
+}
+
+/* Performs Dijkstra's Algorithm on a CSR graph
+ *
+ * Requires:
+ *   - The CSR arrays of the graph to search
+ *   - Vertices covering every id of the graph whose epoch of the current
+ *     request is provided and a heap with room for all of them
+ *     - 0 dist indicates infinity
+ *   - A start index into the array of vertices is provided
+ *   - An end index into the array of vertices is provided
+ *
+ * Guarantees:
+ *   - The shortest path if one exists is found
+ *   - The distance from start to end is returned (0 for no path)
+ *   - The touched vertices are updated with path and distance information
+ *   - The queue is left empty for the next request
+ */
+static inline SEARCH_DIST SEARCH(csr_dijkstras)( uint32_t n_vert
+                                               , const uint32_t *off
+                                               , const SEARCH_VID *dest
+                                               , const SEARCH_COST *cost
+                                               , SEARCH(vertex_t) *v
+                                               , SEARCH(heap_t) *h
+                                               , uint32_t epoch
+                                               , SEARCH_VID start
+                                               , SEARCH_VID end
+                                               )
+{
+    h->size = 0;
+    SEARCH(touch_v)(v, epoch, start);
+    SEARCH(push)(v, h, start);
+
+    while(h->size > 0) {
+        SEARCH_VID s = h->q[1].v;
+        if(s == end) break;
+        SEARCH(pop)(v, h);
+        v[s].visited = 1;
+        if(s >= n_vert) continue; // no outbound edges
+        SEARCH(relax_range)(v, h, epoch, s, dest, cost, off[s], off[s+1]);
+    }
+    h->size = 0; // entries left behind are invalidated by the next epoch
+    return SEARCH(touch_v)(v, epoch, end)->dist;
+}
+
+/* Size the reply of the path a search left from start to end
+ *
+ * Requires:
+ *   - Vertices whose prev chain leads back from end to start
+ *   - The most hops a path may have, which stops a corrupt prev cycle
+ *   - The id to reply for each vertex of a renumbered graph (see
+ *     graph_reorder), or NULL if the vertices are the ids
+ *
+ * Guarantees:
+ *   - The chain is walked once and nothing is written
+ *   - The bytes path_put() writes (including the '\0') will be returned
+ *   - 0 will be returned if there is no path
+ */
+static inline size_t SEARCH(path_len)( const SEARCH(vertex_t) *v
+                                     , const SEARCH_VID *ext
+                                     , SEARCH_VID start
+                                     , SEARCH_VID end
+                                     , uint32_t max_hops
+                                     )
+{
+    size_t len = dec_len(v[end].dist) + 5; // ' (dist)\n\0'
+    uint32_t hops = 0;
+    SEARCH_VID i = end;
+
+    if(0 == v[end].prev) return 0; // end is unreached (or is start)
+    for(;;) {
+        len += dec_len(ext ? ext[i] : i);
+        if(start == i) return len;
+        i = v[i].prev;
+        if(0 == i || ++hops >= max_hops) return 0;
+        len += 2; // '->'
+    }
+}
+
+/* Write the reply of the path a search left from start to end
+ *
+ * Requires:
+ *   - The vertices of a path that path_len() sized, and its ids
+ *   - A buffer of the len bytes it returned
+ *
+ * Guarantees:
+ *   - 'start->...->end (dist)\n' and a '\0' fill the buffer; the ids are
+ *     written back to front straight into their final place
+ */
+static inline void SEARCH(path_put)( const SEARCH(vertex_t) *v
+                                   , const SEARCH_VID *ext
+                                   , SEARCH_VID start
+                                   , SEARCH_VID end
+                                   , char *out
+                                   , size_t len
+                                   )
+{
+    char *p = out + len;
+    SEARCH_VID i = end;
+
+    *--p = '\0';
+    *--p = '\n';
+    *--p = ')';
+    p = dec_put(p, v[end].dist);
+    *--p = '(';
+    *--p = ' ';
+    for(;;) {
+        p = dec_put(p, ext ? ext[i] : i);
+        if(start == i) break;
+        *--p = '>';
+        *--p = '-';
+        i = v[i].prev;
+    }
+}
+
+/* Count the vertices of the path a search left from start to end
+ *
+ * Guarantees:
+ *   - The prev chain is walked as by path_len()
+ *   - The number of vertices (start & end included) will be returned
+ *   - 0 will be returned if there is no path
+ */
+static inline uint32_t SEARCH(path_hops)( const SEARCH(vertex_t) *v
+                                        , SEARCH_VID start
+                                        , SEARCH_VID end
+                                        , uint32_t max_hops
+                                        )
+{
+    uint32_t n = 1;
+    SEARCH_VID i = end;
+
+    if(0 == v[end].prev) return 0;
+    while(start != i) {
+        i = v[i].prev;
+        if(0 == i || n++ >= max_hops) return 0;
+    }
+    return n;
+}
+
+// Writes the n ids of a path counted by path_hops(), start first, to out;
+// ext as for path_len()
+static inline void SEARCH(path_ids)( const SEARCH(vertex_t) *v
+                                   , const SEARCH_VID *ext
+                                   , SEARCH_VID end
+                                   , char *out
+                                   , uint32_t n
+                                   )
+{
+    SEARCH_VID i = end;
+
+    while(n-- > 0) {
+        SEARCH_VID id = ext ? ext[i] : i;
+        memcpy(out + (size_t)n * sizeof(id), &id, sizeof(id));
+        i = v[i].prev;
+    }
+}
+
+#undef SEARCH_VID
+#undef SEARCH_COST
+#undef SEARCH_RELAX8
+#undef SEARCH_DIST
+#undef SEARCH
@@ -0,0 +1,1247 @@
+/* Shortest Path Solver for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "solver.h"
+
+relax8_fn relax8 = NULL;
+
+#if defined(__x86_64__)
+/* AVX2 relax8_fn: the candidate distances of 8 edges against the gathered
+ * distances of their targets
+ *
+ * Guarantees:
+ *   - Bit i is set if edge i's target is unvisited and unreached (or
+ *     stale: its epoch isn't the current one) or farther than dist + cost
+ */
+__attribute__((target("avx2")))
+static uint32_t relax8_avx2( const void *v
+                           , uint32_t epoch
+                           , uint32_t dist
+                           , const uint16_t *dest
+                           , const uint16_t *cost
+                           )
+{
+    const char *base = v;
+    const __m256i zero = _mm256_setzero_si256();
+    // vertex_t is 16 bytes: index * 2, gathered at scale 8
+    __m256i idx = _mm256_slli_epi32(
+        _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)dest)), 1);
+    __m256i cand = _mm256_add_epi32(_mm256_set1_epi32(dist),
+        _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)cost)));
+    __m256i live = _mm256_cmpeq_epi32(_mm256_set1_epi32(epoch),
+        _mm256_i32gather_epi32((const int *)(base + offsetof(vertex_t, epoch)), idx, 8));
+    __m256i cur = _mm256_and_si256(live,
+        _mm256_i32gather_epi32((const int *)(base + offsetof(vertex_t, dist)), idx, 8));
+    __m256i vis = _mm256_and_si256(_mm256_and_si256(live, _mm256_set1_epi32(0xff)),
+        _mm256_i32gather_epi32((const int *)(base + offsetof(vertex_t, visited)), idx, 8));
+    // cand < cur (unsigned) unless max(cand, cur) is cand
+    __m256i lt = _mm256_xor_si256(_mm256_set1_epi32(-1),
+        _mm256_cmpeq_epi32(_mm256_max_epu32(cand, cur), cand));
+    __m256i ok = _mm256_and_si256(_mm256_cmpeq_epi32(vis, zero),
+        _mm256_or_si256(_mm256_cmpeq_epi32(cur, zero), lt));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+}
+#endif
+
+void relax_init(void)
+{
+#if defined(__x86_64__)
+    if(16 == sizeof(vertex_t) && __builtin_cpu_supports("avx2")) {
+        relax8 = relax8_avx2;
+    }
+#endif
+}
+
+int buf_reserve( buf_t *b
+               , size_t sz
+               )
+{
+    char *p = NULL;
+    if(sz <= b->cap) return 0;
+    p = realloc(b->p, sz);
+    if(!p) return -1;
+    b->p = p;
+    b->cap = sz;
+    return 0;
+}
+
+int scratch_init( scratch_t *w
+                , int arity
+                , int queue
+                )
+{
+    memset(w, 0, sizeof(*w));
+    switch(arity) {
+        case 2: w->h.shift = 1; break;
+        case 4: w->h.shift = 2; break;
+        case 8: w->h.shift = 3; break;
+        default: errno = EINVAL; return -1;
+    }
+    w->hb.shift = w->wh.shift = w->h.shift;
+    w->queue = queue;
+    w->v = calloc(VERT_IDX_MAX, sizeof(*w->v));
+    w->h.q = calloc(VERT_IDX_MAX, sizeof(*w->h.q));
+    w->vb = calloc(VERT_IDX_MAX, sizeof(*w->vb));
+    w->hb.q = calloc(VERT_IDX_MAX, sizeof(*w->hb.q));
+    w->bq.head = calloc(BUCKET_MAX, sizeof(*w->bq.head));
+    w->bq.next = calloc(VERT_IDX_MAX, sizeof(*w->bq.next));
+    w->bq.prev = calloc(VERT_IDX_MAX, sizeof(*w->bq.prev));
+    w->mark = calloc(VERT_IDX_MAX, sizeof(*w->mark));
+    if(!w->v || !w->h.q || !w->vb || !w->hb.q
+    || !w->bq.head || !w->bq.next || !w->bq.prev || !w->mark) return -1;
+    return 0;
+}
+
+void scratch_destroy(scratch_t *w)
+{
+    free(w->v);
+    free(w->h.q);
+    free(w->vb);
+    free(w->hb.q);
+    free(w->bq.head);
+    free(w->bq.next);
+    free(w->bq.prev);
+    free(w->mark);
+    free(w->wv);
+    free(w->wh.q);
+    free(w->wg.off);
+    free(w->in.b.p);
+    free(w->path.p);
+    free(w->tree.p);
+    free(w->g.off);
+    free(w->g.roff);
+    memset(w, 0, sizeof(*w));
+}
+
+void scratch_next_epoch(scratch_t *w)
+{
+    if(0 == ++w->epoch) { // wrapped; stale stamps could now look current
+        memset(w->v, 0, sizeof(*w->v) * VERT_IDX_MAX);
+        memset(w->vb, 0, sizeof(*w->vb) * VERT_IDX_MAX);
+        memset(w->mark, 0, sizeof(*w->mark) * VERT_IDX_MAX);
+        memset(w->wv, 0, sizeof(*w->wv) * w->wcap);
+        w->epoch = 1;
+    }
+}
+
+int scratch_wide( scratch_t *w
+                , uint32_t n
+                )
+{
+    wvertex_t *v = NULL;
+    wslot_t *q = NULL;
+
+    if(n <= w->wcap) return 0;
+    v = realloc(w->wv, sizeof(*v) * n);
+    if(!v) return -1;
+    w->wv = v;
+    memset(v + w->wcap, 0, sizeof(*v) * (n - w->wcap));
+    q = realloc(w->wh.q, sizeof(*q) * ((size_t)n + 1)); // heap slots 1..n
+    if(!q) return -1;
+    w->wh.q = q;
+    w->wcap = n;
+    return 0;
+}
+
+int build_csr( graph_t *g
+             , const uint16_t *rec
+             , uint32_t n
+             )
+{
+    uint64_t n_vert = 0, n_ids = 0;
+    uint32_t n_edge = 0;
+    size_t sz = 0;
+
+    csr_count((const char *)rec, n, &n_vert, &n_ids, &n_edge);
+    sz = sizeof(*g->off) * (n_vert + 1) + sizeof(*g->dest) * n_edge * 2;
+    if(sz > g->cap) {
+        free(g->off);
+        g->cap = 0;
+        g->off = malloc(sz);
+        if(!g->off) return -1;
+        g->cap = sz;
+    }
+    g->dest = (uint16_t *)(g->off + n_vert + 1);
+    g->cost = g->dest + n_edge;
+    g->n_vert = n_vert;
+    g->n_edge = n_edge;
+    g->has_rev = 0;
+    g->max_cost = csr_scatter((const char *)rec, n, n_vert, g->off, g->dest, g->cost);
+    return 0;
+}
+
+int build_rev(graph_t *g)
+{
+    uint32_t i = 0, k = 0, rn_vert = 0;
+    size_t sz = 0;
+
+    for(k = 0; k < g->n_edge; ++k) {
+        if(g->dest[k] >= rn_vert) rn_vert = g->dest[k] + 1;
+    }
+    sz = sizeof(*g->roff) * (rn_vert + 1) + sizeof(*g->rsrc) * g->n_edge * 2;
+    if(sz > g->rcap) {
+        free(g->roff);
+        g->rcap = 0;
+        g->roff = malloc(sz);
+        if(!g->roff) return -1;
+        g->rcap = sz;
+    }
+    g->rsrc = (uint16_t *)(g->roff + rn_vert + 1);
+    g->rcost = g->rsrc + g->n_edge;
+    g->rn_vert = rn_vert;
+
+    memset(g->roff, 0, sizeof(*g->roff) * (rn_vert + 1));
+    for(k = 0; k < g->n_edge; ++k) ++g->roff[g->dest[k] + 1]; // in-degrees
+    for(i = 1; i <= rn_vert; ++i) g->roff[i] += g->roff[i-1];
+    for(i = 0; i < g->n_vert; ++i) {
+        for(k = g->off[i]; k < g->off[i+1]; ++k) {
+            uint32_t r = g->roff[g->dest[k]]++;
+            g->rsrc[r] = i;
+            g->rcost[r] = g->cost[k];
+        }
+    }
+    for(i = rn_vert; i > 0; --i) g->roff[i] = g->roff[i-1];
+    g->roff[0] = 0;
+    g->has_rev = 1;
+    return 0;
+}
+
+// Returns the edges of vertex i in either direction
+static uint32_t undirected_deg( const graph_t *g
+                              , uint32_t i
+                              )
+{
+    uint32_t d = 0;
+    if(i < g->n_vert) d += g->off[i+1] - g->off[i];
+    if(i < g->rn_vert) d += g->roff[i+1] - g->roff[i];
+    return d;
+}
+
+static int key_cmp( const void *a
+                  , const void *b
+                  )
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Numbers vertex i next (k is the last number given), unless it has one
+static inline void order_take( uint16_t *to_ext
+                             , uint16_t *to_int
+                             , uint32_t *k
+                             , uint16_t i
+                             )
+{
+    if(0 == i || 0 != to_int[i]) return;
+    to_int[i] = ++*k;
+    to_ext[*k] = i;
+}
+
+int graph_reorder( graph_t *g
+                 , int order
+                 )
+{
+    uint32_t n = g->n_vert > g->rn_vert ? g->n_vert : g->rn_vert;
+    uint32_t i = 0, j = 0, k = 0, e = 0, head = 1, n_key = 0, nv = 0;
+    uint16_t *to_ext = NULL, *to_int = NULL;
+    uint64_t *key = NULL, *nb = NULL;
+    graph_t ng;
+    size_t sz = 0;
+
+    if(ORDER_NONE == order) return 0;
+    if(g->wide || !g->has_rev || g->to_ext || g->ch.n_vert || g->alt.k) {
+        return -1;
+    }
+    to_ext = calloc(2 * VERT_IDX_MAX, sizeof(*to_ext));
+    key = malloc(sizeof(*key) * (n + 1));
+    nb = malloc(sizeof(*nb) * (n + 1));
+    if(!to_ext || !key || !nb) goto error;
+    to_int = to_ext + VERT_IDX_MAX;
+
+    // Roots of the searches, or all of the order by degree: degree << 16 | id
+    // keys sort by degree, then id
+    for(i = 1; i < n; ++i) {
+        uint64_t d = undirected_deg(g, i);
+        if(0 == d) continue;
+        if(ORDER_RCM == order) key[n_key++] = d << 16 | i;
+        else if(ORDER_DEGREE == order) key[n_key++] = (UINT32_MAX - d) << 16 | i;
+        else key[n_key++] = i;
+    }
+    if(ORDER_BFS != order) qsort(key, n_key, sizeof(*key), key_cmp);
+    for(i = 0; i < n_key; ++i) {
+        order_take(to_ext, to_int, &k, key[i] & 0xffff);
+        if(ORDER_DEGREE == order) continue;
+        while(head <= k) { // breadth-first; to_ext is the queue
+            uint16_t u = to_ext[head++];
+            uint32_t first = k + 1;
+            if(u < g->n_vert) {
+                for(e = g->off[u]; e < g->off[u+1]; ++e) {
+                    order_take(to_ext, to_int, &k, g->dest[e]);
+                }
+            }
+            if(u < g->rn_vert) {
+                for(e = g->roff[u]; e < g->roff[u+1]; ++e) {
+                    order_take(to_ext, to_int, &k, g->rsrc[e]);
+                }
+            }
+            if(ORDER_RCM != order || k <= first) continue;
+            for(j = first; j <= k; ++j) { // Cuthill-McKee: by degree
+                nb[j - first] = (uint64_t)undirected_deg(g, to_ext[j]) << 16
+                              | to_ext[j];
+            }
+            qsort(nb, k - first + 1, sizeof(*nb), key_cmp);
+            for(j = first; j <= k; ++j) {
+                to_ext[j] = nb[j - first] & 0xffff;
+                to_int[to_ext[j]] = j;
+            }
+        }
+    }
+    if(ORDER_RCM == order) {
+        for(i = 1, j = k; i < j; ++i, --j) {
+            uint16_t x = to_ext[i];
+            to_ext[i] = to_ext[j];
+            to_ext[j] = x;
+        }
+        for(i = 1; i <= k; ++i) to_int[to_ext[i]] = i;
+    }
+    for(i = 1; i < VERT_IDX_MAX; ++i) order_take(to_ext, to_int, &k, i);
+
+    for(i = 0; i < g->n_vert; ++i) {
+        if(g->off[i+1] > g->off[i] && to_int[i] >= nv) nv = to_int[i] + 1;
+    }
+    ng = *g;
+    ng.roff = NULL;
+    ng.rcap = 0;
+    ng.has_rev = 0;
+    sz = sizeof(*ng.off) * (nv + 1) + sizeof(*ng.dest) * g->n_edge * 2;
+    if(!(ng.off = malloc(sz))) goto error;
+    ng.cap = sz;
+    ng.n_vert = nv;
+    ng.dest = (uint16_t *)(ng.off + nv + 1);
+    ng.cost = ng.dest + g->n_edge;
+    ng.off[0] = 0;
+    for(i = 0; i < nv; ++i) {
+        uint16_t u = to_ext[i];
+        uint32_t at = ng.off[i];
+        if(u < g->n_vert) {
+            for(e = g->off[u]; e < g->off[u+1]; ++e, ++at) {
+                ng.dest[at] = to_int[g->dest[e]];
+                ng.cost[at] = g->cost[e];
+            }
+        }
+        ng.off[i+1] = at;
+    }
+    if(0 != build_rev(&ng)) {
+        free(ng.off);
+        goto error;
+    }
+    if(g->cap) free(g->off); // 0 if it points into a graph file
+    if(g->rcap) free(g->roff);
+    ng.to_ext = to_ext;
+    ng.to_int = to_int;
+    *g = ng;
+    free(key);
+    free(nb);
+    return 0;
+error:
+    free(to_ext);
+    free(key);
+    free(nb);
+    return -1;
+}
+
+int graph_copy( graph_t *dst
+              , const graph_t *src
+              )
+{
+    size_t n = sizeof(*src->off) * (src->n_vert + 1);
+    size_t m = sizeof(*src->dest) * src->n_edge;
+
+    *dst = *src; // ch & alt stay shared
+    dst->off = dst->roff = NULL;
+    dst->cap = dst->rcap = 0;
+    dst->wide = NULL;
+    if(src->wide) {
+        const wgraph_t *w = src->wide;
+        size_t wn = sizeof(*w->off) * (w->n_vert + 1);
+        size_t wm = sizeof(*w->dest) * w->n_edge;
+        if(!(dst->wide = malloc(sizeof(*dst->wide)))) return -1;
+        *dst->wide = *w;
+        if(!(dst->wide->off = malloc(wn + wm * 2))) goto error;
+        dst->wide->cap = wn + wm * 2;
+        dst->wide->dest = dst->wide->off + w->n_vert + 1;
+        dst->wide->cost = dst->wide->dest + w->n_edge;
+        memcpy(dst->wide->off, w->off, wn);
+        memcpy(dst->wide->dest, w->dest, wm);
+        memcpy(dst->wide->cost, w->cost, wm);
+        return 0;
+    }
+    if(!(dst->off = malloc(n + m * 2))) goto error;
+    dst->cap = n + m * 2;
+    dst->dest = (uint16_t *)(dst->off + src->n_vert + 1);
+    dst->cost = dst->dest + src->n_edge;
+    memcpy(dst->off, src->off, n);
+    memcpy(dst->dest, src->dest, m);
+    memcpy(dst->cost, src->cost, m);
+    if(src->has_rev) {
+        n = sizeof(*src->roff) * (src->rn_vert + 1);
+        if(!(dst->roff = malloc(n + m * 2))) goto error;
+        dst->rcap = n + m * 2;
+        dst->rsrc = (uint16_t *)(dst->roff + src->rn_vert + 1);
+        dst->rcost = dst->rsrc + src->n_edge;
+        memcpy(dst->roff, src->roff, n);
+        memcpy(dst->rsrc, src->rsrc, m);
+        memcpy(dst->rcost, src->rcost, m);
+    }
+    return 0;
+error:
+    graph_copy_free(dst);
+    return -1;
+}
+
+void graph_copy_free(graph_t *g)
+{
+    if(g->wide) free(g->wide->off);
+    free(g->wide);
+    free(g->off);
+    free(g->roff);
+    memset(g, 0, sizeof(*g));
+}
+
+// A wide build split over threads. Records are partitioned by the vertex
+// range of their source, keeping their order, so each range's offsets and
+// edges are laid out by one thread exactly as the serial build would
+typedef struct {
+    const char *rec;
+    uint32_t n;
+    uint32_t n_vert;
+    uint32_t n_part;   // chunks and ranges; build_threads
+    uint32_t *pos;     // n_part * n_part: records of chunk c in range r, then
+                       // where they go in idx ([c * n_part + r])
+    uint32_t *base;    // n_part + 1 starts of each range in idx & the edges
+    uint32_t *idx;     // record indices grouped by range
+    wgraph_t *g;
+    pthread_mutex_t mu; // wbuild_sync() state
+    pthread_cond_t cv;
+    uint32_t n_thr;    // threads running the build; each takes every n_thr-th
+                       // chunk (or range)
+    uint32_t n_wait;   // threads waiting in wbuild_sync()
+    uint32_t gen;      // wbuild_sync() rounds completed
+} wbuild_t;
+
+enum { WBUILD_COUNT, WBUILD_PARTITION, WBUILD_SCATTER };
+
+typedef struct {
+    wbuild_t *b;
+    uint32_t id;       // 0 is the thread that called wbuild_par()
+    pthread_t tid;
+} wpart_t;
+
+uint32_t build_threads = 1;
+
+// Returns the range (of n_part equal slices of the vertices) of vertex v
+static inline uint32_t wrange( const wbuild_t *b
+                             , uint32_t v
+                             )
+{
+    return (uint64_t)v * b->n_part / b->n_vert;
+}
+
+// Runs one phase of a wide build on chunk (or range) t
+static void wbuild_phase( wbuild_t *b
+                        , int phase
+                        , uint32_t t
+                        )
+{
+    uint32_t i = 0, k = 0;
+    uint32_t lo = (uint64_t)b->n * t / b->n_part;
+    uint32_t hi = (uint64_t)b->n * (t + 1) / b->n_part;
+    uint32_t *pos = b->pos + (size_t)t * b->n_part;
+
+    switch(phase) {
+        case WBUILD_COUNT: // records of each range in chunk t
+            for(i = lo; i < hi; ++i) {
+                uint32_t a = wrec_get(b->rec, i, 0);
+                if(0 == a || 0 == wrec_get(b->rec, i, 1)) continue;
+                ++pos[wrange(b, a)];
+            }
+            break;
+        case WBUILD_PARTITION: // group chunk t's records by range
+            for(i = lo; i < hi; ++i) {
+                uint32_t a = wrec_get(b->rec, i, 0);
+                if(0 == a || 0 == wrec_get(b->rec, i, 1)) continue;
+                b->idx[pos[wrange(b, a)]++] = i;
+            }
+            break;
+        case WBUILD_SCATTER: { // lay range t out; off[v] ends as v's end
+            uint32_t *off = b->g->off;
+            uint32_t v_lo = ((uint64_t)b->n_vert * t + b->n_part - 1) / b->n_part;
+            uint32_t v_hi = ((uint64_t)b->n_vert * (t + 1) + b->n_part - 1)
+                          / b->n_part;
+            uint32_t sum = b->base[t];
+            memset(off + v_lo, 0, sizeof(*off) * (v_hi - v_lo));
+            for(k = b->base[t]; k < b->base[t+1]; ++k) {
+                ++off[wrec_get(b->rec, b->idx[k], 0)];
+            }
+            for(i = v_lo; i < v_hi; ++i) { // exclusive prefix sum
+                uint32_t c = off[i];
+                off[i] = sum;
+                sum += c;
+            }
+            for(k = b->base[t]; k < b->base[t+1]; ++k) {
+                uint32_t r = b->idx[k], e = off[wrec_get(b->rec, r, 0)]++;
+                b->g->dest[e] = wrec_get(b->rec, r, 1);
+                b->g->cost[e] = wrec_get(b->rec, r, 2);
+            }
+            break;
+        }
+    }
+}
+
+// Waits until all n_thr threads of a wide build have reached this call
+static void wbuild_sync(wbuild_t *b)
+{
+    uint32_t gen = 0;
+
+    pthread_mutex_lock(&b->mu);
+    gen = b->gen;
+    if(++b->n_wait == b->n_thr) {
+        b->n_wait = 0;
+        ++b->gen;
+        pthread_cond_broadcast(&b->cv);
+    } else {
+        while(gen == b->gen) pthread_cond_wait(&b->cv, &b->mu);
+    }
+    pthread_mutex_unlock(&b->mu);
+}
+
+// Turns the per-chunk range counts into where each chunk's records of each
+// range go in idx: range by range, chunks in order
+static void wbuild_offsets(wbuild_t *b)
+{
+    uint32_t c = 0, r = 0, sum = 0;
+
+    for(r = 0; r < b->n_part; ++r) {
+        b->base[r] = sum;
+        for(c = 0; c < b->n_part; ++c) {
+            uint32_t k = b->pos[(size_t)c * b->n_part + r];
+            b->pos[(size_t)c * b->n_part + r] = sum;
+            sum += k;
+        }
+    }
+    b->base[b->n_part] = sum;
+}
+
+// Runs every phase of a wide build on thread id's chunks (and ranges)
+static void * wbuild_thread(void *arg)
+{
+    wpart_t *wp = arg;
+    wbuild_t *b = wp->b;
+    uint32_t t = 0;
+
+    wbuild_sync(b); // n_thr is final once every thread has started
+    for(t = wp->id; t < b->n_part; t += b->n_thr) {
+        wbuild_phase(b, WBUILD_COUNT, t);
+    }
+    wbuild_sync(b);
+    if(0 == wp->id) wbuild_offsets(b);
+    wbuild_sync(b);
+    for(t = wp->id; t < b->n_part; t += b->n_thr) {
+        wbuild_phase(b, WBUILD_PARTITION, t);
+    }
+    wbuild_sync(b);
+    for(t = wp->id; t < b->n_part; t += b->n_thr) {
+        wbuild_phase(b, WBUILD_SCATTER, t);
+    }
+    return NULL;
+}
+
+/* Lay the records of a wide graph out over build_threads threads
+ *
+ * Requires:
+ *   - A wgraph_t sized for the records (see wbuild_csr)
+ *
+ * Guarantees:
+ *   - The graph is laid out exactly as wcsr_scatter() would
+ *   - One set of threads, started once, counts, partitions and scatters
+ *     the source ranges in parallel; only the n_part^2 partition offsets
+ *     and the final shift of the offsets are serial
+ *   - If fewer threads can be started, those that are split the work
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the partition can't be allocated
+ */
+static int wbuild_par( wgraph_t *g
+                     , const char *rec
+                     , uint32_t n
+                     )
+{
+    wbuild_t b;
+    wpart_t *wp = NULL;
+    uint32_t t = 0;
+    int rc = -1;
+
+    memset(&b, 0, sizeof(b));
+    b.rec = rec;
+    b.n = n;
+    b.n_vert = g->n_vert;
+    b.n_part = build_threads;
+    b.g = g;
+    b.n_thr = 1;
+    pthread_mutex_init(&b.mu, NULL);
+    pthread_cond_init(&b.cv, NULL);
+    b.pos = calloc((size_t)b.n_part * b.n_part, sizeof(*b.pos));
+    b.base = calloc(b.n_part + 1, sizeof(*b.base));
+    b.idx = malloc(sizeof(*b.idx) * ((size_t)g->n_edge + 1));
+    wp = calloc(b.n_part, sizeof(*wp));
+    if(!b.pos || !b.base || !b.idx || !wp) goto cleanup;
+
+    // started threads wait in wbuild_sync() until n_thr is set
+    pthread_mutex_lock(&b.mu);
+    for(t = 0; t < b.n_part; ++t) {
+        wp[t].b = &b;
+        wp[t].id = t;
+    }
+    for(t = 1; t < b.n_part; ++t) {
+        if(0 != pthread_create(&wp[t].tid, NULL, wbuild_thread, &wp[t])) break;
+    }
+    b.n_thr = t;
+    pthread_mutex_unlock(&b.mu);
+    wbuild_thread(&wp[0]);
+    for(t = 1; t < b.n_thr; ++t) pthread_join(wp[t].tid, NULL);
+    memmove(g->off + 1, g->off, sizeof(*g->off) * g->n_vert); // ends to starts
+    g->off[0] = 0;
+    rc = 0;
+cleanup:
+    free(b.pos);
+    free(b.base);
+    free(b.idx);
+    free(wp);
+    pthread_mutex_destroy(&b.mu);
+    pthread_cond_destroy(&b.cv);
+    return rc;
+}
+
+int wbuild_csr( wgraph_t *g
+              , const char *rec
+              , uint32_t n
+              , const csr_sizes_t *pre
+              )
+{
+    csr_sizes_t c;
+    size_t sz = 0;
+
+    if(pre && n == pre->n_rec) c = *pre;
+    else wcsr_count(rec, n, &c.n_vert, &c.n_ids, &c.n_edge);
+    if(c.n_ids > WIDE_ID_MAX) return -1;
+    sz = sizeof(*g->off) * (c.n_vert + 1) + sizeof(*g->dest) * c.n_edge * 2;
+    if(sz > g->cap) {
+        free(g->off);
+        g->cap = 0;
+        g->off = malloc(sz);
+        if(!g->off) return -1;
+        g->cap = sz;
+    }
+    g->dest = g->off + c.n_vert + 1;
+    g->cost = g->dest + c.n_edge;
+    g->n_vert = c.n_vert;
+    g->n_ids = c.n_ids;
+    g->n_edge = c.n_edge;
+    if(build_threads > 1 && n >= WBUILD_PAR_MIN && c.n_vert > 0) {
+        return wbuild_par(g, rec, n);
+    }
+    wcsr_scatter(rec, n, c.n_vert, g->off, g->dest, g->cost);
+    return 0;
+}
+
+int load_map( const char *msg
+            , graph_t *g
+            , uint16_t *start
+            , uint16_t *end
+            )
+{
+    uint16_t hdr[3] = {0}; // start, end, # edges that follow
+
+    memcpy(hdr, msg, sizeof(hdr));
+    *start = hdr[0];
+    *end = hdr[1];
+    return build_csr(g, (const uint16_t *)(msg + MSG_HDR_SZ), hdr[2]);
+}
+
+int load_wmap( const char *msg
+             , const csr_sizes_t *pre
+             , wgraph_t *g
+             , uint32_t *start
+             , uint32_t *end
+             )
+{
+    uint32_t hdr[3] = {0}; // start, end, # edges that follow
+
+    memcpy(hdr, msg, sizeof(hdr));
+    *start = hdr[0];
+    *end = hdr[1];
+    return wbuild_csr(g, msg + MSG_WHDR_SZ, hdr[2], pre);
+}
+
+// Adds a search of algo and the n queue tallies it left to the metrics
+static void solve_metrics( metrics_t *m
+                         , int algo
+                         , const qstat_t *st
+                         , uint32_t n
+                         )
+{
+    uint32_t i = 0;
+
+    metric_add(&m->searches[algo], 1);
+    for(i = 0; i < n; ++i) {
+        metric_add(&m->settled[algo], st[i].pops);
+        metric_add(&m->edges, st[i].edges);
+        metric_add(&m->queue_ops, st[i].pushes + st[i].pops + st[i].decs);
+    }
+}
+
+int dijkstras( const graph_t *g
+             , scratch_t *w
+             , uint16_t start
+             , uint16_t end
+             )
+{
+    return csr_dijkstras( g->n_vert, g->off, g->dest, g->cost
+                        , w->v, &w->h, w->epoch, start, end);
+}
+
+void dijkstras_many( const graph_t *g
+                   , scratch_t *w
+                   , uint16_t start
+                   , const char *targets
+                   , uint32_t n
+                   )
+{
+    vertex_t *v = w->v;
+    heap_t *h = &w->h;
+    uint64_t t_search = metrics_now();
+    uint32_t i = 0, left = 0;
+
+    memset(&h->st, 0, sizeof(h->st));
+    for(i = 0; i < n; ++i) { // count distinct targets
+        uint16_t t = 0;
+        memcpy(&t, targets + i * sizeof(t), sizeof(t));
+        t = graph_vert(g, t);
+        if(w->mark[t] != w->epoch) {
+            w->mark[t] = w->epoch;
+            ++left;
+        }
+    }
+    h->size = 0;
+    touch(w, start);
+    push(v, h, start);
+    while(h->size > 0) {
+        uint16_t s = pop(v, h);
+        v[s].visited = 1;
+        if(w->mark[s] == w->epoch && 0 == --left) break;
+        if(s >= g->n_vert) continue; // no outbound edges
+        relax_range(v, h, w->epoch, s, g->dest, g->cost, g->off[s], g->off[s+1]);
+    }
+    h->size = 0; // entries left behind are invalidated by the next epoch
+    solve_metrics(&w->m, ALGO_DIJKSTRA, &h->st, 1);
+    hist_add(&w->m.phase[PHASE_SEARCH], metrics_now() - t_search);
+}
+
+// Queues v[i] in the bucket of its distance
+static inline void bq_link( bucketq_t *q
+                          , vertex_t *v
+                          , uint16_t i
+                          , uint32_t b
+                          )
+{
+    uint16_t h = q->head[b];
+    q->next[i] = h;
+    q->prev[i] = 0;
+    if(0 != h) q->prev[h] = i;
+    q->head[b] = i;
+    v[i].q_idx = 1; // queued; the bucket queue has no positions
+}
+
+// Removes v[i] from bucket b
+static inline void bq_unlink( bucketq_t *q
+                            , vertex_t *v
+                            , uint16_t i
+                            , uint32_t b
+                            )
+{
+    if(0 != q->prev[i]) q->next[q->prev[i]] = q->next[i];
+    else q->head[b] = q->next[i];
+    if(0 != q->next[i]) q->prev[q->next[i]] = q->prev[i];
+    v[i].q_idx = 0;
+}
+
+int dials( const graph_t *g
+         , scratch_t *w
+         , uint16_t start
+         , uint16_t end
+         )
+{
+    vertex_t *v = w->v;
+    bucketq_t *q = &w->bq;
+    uint32_t n_bucket = (uint32_t)g->max_cost + 1, cur = 0, size = 0, k = 0;
+
+    touch(w, start);
+    if(0 == start) return 0; // 0 is the empty link
+    bq_link(q, v, start, 0);
+    ++q->st.pushes;
+    size = 1;
+
+    while(size > 0) {
+        uint16_t s = 0;
+        uint32_t k_end = 0;
+        while(0 == q->head[cur % n_bucket]) ++cur; // s will be at dist cur
+        s = q->head[cur % n_bucket];
+        ++q->st.pops;
+        if(s == end) break;
+        bq_unlink(q, v, s, cur % n_bucket);
+        --size;
+        v[s].visited = 1;
+        if(s >= g->n_vert) continue; // no outbound edges
+        q->st.edges += g->off[s+1] - g->off[s];
+        for(k = g->off[s], k_end = g->off[s+1]; k < k_end; ++k) {
+            uint16_t d = g->dest[k];
+            uint32_t old = touch(w, d)->dist;
+            uint32_t dist = v[s].dist + g->cost[k];
+            if(0 == v[d].visited && (0 == old || dist < old)) {
+                if(0 != v[d].q_idx) {
+                    bq_unlink(q, v, d, old % n_bucket);
+                    ++q->st.decs;
+                }
+                else {
+                    ++size;
+                    ++q->st.pushes;
+                }
+                v[d].dist = dist;
+                v[d].prev = s;
+                bq_link(q, v, d, dist % n_bucket);
+            }
+        }
+    }
+    for(k = 0; size > 0 && k < n_bucket; ++k) { // empty what's left behind
+        uint32_t b = (cur + k) % n_bucket;
+        uint16_t i = 0;
+        for(i = q->head[b]; 0 != i; i = q->next[i]) --size;
+        q->head[b] = 0;
+    }
+    return touch(w, end)->dist;
+}
+
+int bidijkstras( const graph_t *g
+               , scratch_t *w
+               , uint16_t start
+               , uint16_t end
+               )
+{
+    vertex_t *v = w->v, *vb = w->vb;
+    heap_t *h = &w->h, *hb = &w->hb;
+    uint32_t best = 0; // 0 represents infinity
+    uint16_t meet = 0, i = 0;
+
+    h->size = hb->size = 0;
+    touch(w, start);
+    touch_v(vb, w->epoch, end);
+    if(start == end) return 0; // like dijkstras(): no path to itself
+    push(v, h, start);
+    push(vb, hb, end);
+
+    while(h->size > 0 && hb->size > 0) {
+        // the roots are at 0: their dist of 0 is real, not infinity
+        uint32_t top = h->q[1].dist, btop = hb->q[1].dist;
+        int fwd = h->q[1].v == start || (hb->q[1].v != end && top <= btop);
+        vertex_t *x = fwd ? v : vb, *y = fwd ? vb : v;
+        heap_t *hx = fwd ? h : hb;
+        const uint32_t *off = fwd ? g->off : g->roff;
+        const uint16_t *adj = fwd ? g->dest : g->rsrc;
+        const uint16_t *cost = fwd ? g->cost : g->rcost;
+        uint32_t n_vert = fwd ? g->n_vert : g->rn_vert;
+        uint16_t s = 0, o = fwd ? end : start; // o: root of the other side
+        uint32_t k = 0, k_end = 0;
+
+        if(0 != best && top + btop >= best) break; // meet-in-the-middle rule
+        s = pop(x, hx);
+        x[s].visited = 1;
+        if(s >= n_vert) continue; // no edges this way
+        hx->st.edges += off[s+1] - off[s];
+        for(k = off[s], k_end = off[s+1]; k < k_end; ++k) {
+            uint16_t d = adj[k];
+            uint32_t cur = touch_v(x, w->epoch, d)->dist;
+            uint32_t dist = x[s].dist + cost[k];
+            vertex_t *yd = touch_v(y, w->epoch, d);
+            if(0 == x[d].visited && (0 == cur || dist < cur)) {
+                x[d].dist = dist;
+                x[d].prev = s;
+                if(0 == x[d].q_idx) push(x, hx, d);
+                else decrease(x, hx, d);
+            }
+            if(d == o || 0 != yd->dist) { // reached by the other side
+                uint32_t via = x[d].dist + yd->dist;
+                if(0 == best || via < best) {
+                    best = via;
+                    meet = d;
+                }
+            }
+        }
+    }
+    h->size = hb->size = 0;
+    if(0 == best) return 0;
+    for(i = meet; i != end; ) { // stitch: vb's prev points toward end
+        uint16_t next = vb[i].prev;
+        touch(w, next)->prev = i;
+        i = next;
+    }
+    v[end].dist = best;
+    return best;
+}
+
+/* Rewrites the forward prev chain over the arc a->b into graph edges
+ *
+ * Requires:
+ *   - An arc of the graph's contraction hierarchy whose end b is on the
+ *     forward prev chain of the current request
+ *   - The queues are empty; their arrays are the stack of arcs to unpack
+ *
+ * Guarantees:
+ *   - The vertices each shortcut was contracted through are spliced in
+ *     between a and b, recursively, so prev only follows graph edges
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the arcs don't unpack into a simple path
+ */
+static int ch_unpack( const graph_t *g
+                    , scratch_t *w
+                    , uint16_t a
+                    , uint16_t b
+                    )
+{
+    slot_t *sa = w->h.q, *sb = w->hb.q; // pending arcs: sa[i].v->sb[i].v
+    uint32_t n = 0;
+
+    sa[n].v = a;
+    sb[n].v = b;
+    ++n;
+    while(n > 0) {
+        uint16_t m = 0;
+        --n;
+        a = sa[n].v;
+        b = sb[n].v;
+        m = ch_mid(&g->ch, a, b);
+        if(0 == m) {
+            touch(w, b)->prev = a;
+            continue;
+        }
+        if(n + 2 > VERT_IDX_MAX) return -1;
+        sa[n].v = m; // a->m is unpacked last, after m->b
+        sb[n].v = b;
+        ++n;
+        sa[n].v = a;
+        sb[n].v = m;
+        ++n;
+    }
+    return 0;
+}
+
+int chdijkstras( const graph_t *g
+               , scratch_t *w
+               , uint16_t start
+               , uint16_t end
+               )
+{
+    const ch_t *ch = &g->ch;
+    vertex_t *v = w->v, *vb = w->vb;
+    heap_t *h = &w->h, *hb = &w->hb;
+    uint32_t best = 0, hops = 0; // 0 represents infinity
+    uint16_t meet = 0, i = 0;
+
+    h->size = hb->size = 0;
+    touch(w, start);
+    touch_v(vb, w->epoch, end);
+    if(start == end) return 0; // like dijkstras(): no path to itself
+    push(v, h, start);
+    push(vb, hb, end);
+
+    while(h->size > 0 || hb->size > 0) {
+        // the roots are at 0: their dist of 0 is real, not infinity
+        int fwd = 0 == hb->size
+               || (h->size > 0 && (h->q[1].v == start || (hb->q[1].v != end
+                   && h->q[1].dist <= hb->q[1].dist)));
+        vertex_t *x = fwd ? v : vb, *y = fwd ? vb : v;
+        heap_t *hx = fwd ? h : hb;
+        const uint32_t *off = fwd ? ch->uoff : ch->doff;
+        const ch_arc_t *arc = fwd ? ch->up : ch->dn;
+        uint16_t s = hx->q[1].v, o = fwd ? end : start; // o: root of the other side
+        uint32_t k = 0, k_end = 0;
+
+        if(0 != best && x[s].dist >= best) {
+            hx->size = 0; // this side can't improve on best
+            continue;
+        }
+        pop(x, hx);
+        x[s].visited = 1;
+        if(s >= ch->n_vert) continue; // no arcs
+        hx->st.edges += off[s+1] - off[s];
+        for(k = off[s], k_end = off[s+1]; k < k_end; ++k) {
+            uint16_t d = arc[k].to;
+            uint32_t cur = touch_v(x, w->epoch, d)->dist;
+            uint32_t dist = x[s].dist + arc[k].cost;
+            vertex_t *yd = touch_v(y, w->epoch, d);
+            if(0 == x[d].visited && (0 == cur || dist < cur)) {
+                x[d].dist = dist;
+                x[d].prev = s;
+                if(0 == x[d].q_idx) push(x, hx, d);
+                else decrease(x, hx, d);
+            }
+            if(d == o || 0 != yd->dist) { // reached by the other side
+                uint32_t via = x[d].dist + yd->dist;
+                if(0 == best || via < best) {
+                    best = via;
+                    meet = d;
+                }
+            }
+        }
+    }
+    h->size = hb->size = 0;
+    if(0 == best) return 0;
+    for(i = meet; i != end; ) { // stitch: vb's prev points toward end
+        uint16_t next = vb[i].prev;
+        touch(w, next)->prev = i;
+        i = next;
+    }
+    for(i = end; i != start; ++hops) { // unpack the arcs back to start
+        uint16_t a = v[i].prev;
+        if(hops >= VERT_IDX_MAX || 0 != ch_unpack(g, w, a, i)) return 0;
+        i = a;
+    }
+    v[end].dist = best;
+    return best;
+}
+
+// Returns the ALT bound from i to the end of the current search; the bound
+// of each vertex is computed once per request and kept in vb (see altdijkstras)
+static inline uint32_t alt_pot( const graph_t *g
+                              , scratch_t *w
+                              , uint16_t i
+                              , uint16_t end
+                              )
+{
+    vertex_t *x = touch_v(w->vb, w->epoch, i);
+    if(0 == x->visited) {
+        x->dist = alt_bound(&g->alt, i, end);
+        x->visited = 1;
+    }
+    return x->dist;
+}
+
+int altdijkstras( const graph_t *g
+                , scratch_t *w
+                , uint16_t start
+                , uint16_t end
+                )
+{
+    vertex_t *v = w->v;
+    heap_t *h = &w->h;
+    uint32_t k = 0, k_end = 0, pot = 0;
+
+    h->size = 0;
+    touch(w, start);
+    touch(w, end);
+    if(start == end) return 0; // like dijkstras(): no path to itself
+    if(ALT_NONE == (pot = alt_pot(g, w, start, end))) return 0;
+    v[start].dist = pot;
+    push(v, h, start);
+    while(h->size > 0) {
+        uint16_t s = pop(v, h);
+        uint32_t dist = 0;
+        v[s].visited = 1;
+        if(s == end) break;
+        if(s >= g->n_vert) continue; // no outbound edges
+        dist = v[s].dist - alt_pot(g, w, s, end);
+        h->st.edges += g->off[s+1] - g->off[s];
+        for(k = g->off[s], k_end = g->off[s+1]; k < k_end; ++k) {
+            uint16_t d = g->dest[k];
+            uint32_t cur = 0;
+            uint64_t key = 0;
+            if(ALT_NONE == (pot = alt_pot(g, w, d, end))) continue;
+            cur = touch(w, d)->dist;
+            key = (uint64_t)dist + g->cost[k] + pot;
+            if(key > UINT32_MAX) key = UINT32_MAX;
+            if(0 == v[d].visited && (0 == cur || key < cur)) {
+                v[d].dist = key;
+                v[d].prev = s;
+                if(0 == v[d].q_idx) push(v, h, d);
+                else decrease(v, h, d);
+            }
+        }
+    }
+    h->size = 0;
+    return v[end].dist;
+}
+
+char * bin_reply( scratch_t *w
+                , uint8_t status
+                , uint8_t width
+                , uint32_t n
+                , uint64_t dist
+                )
+{
+    bin_reply_t hdr = {status, width, 0, n, dist};
+
+    w->reply_len = sizeof(hdr) + (size_t)n * width;
+    if(0 != buf_reserve(&w->path, w->reply_len)) return NULL;
+    memcpy(w->path.p, &hdr, sizeof(hdr));
+    return w->path.p;
+}
+
+char * gen_path( scratch_t *w
+               , const uint16_t *ext
+               , uint16_t start
+               , uint16_t end
+               )
+{
+    // The path is sized by a first walk of the prev chain, then formatted
+    // back to front straight into the reused path buffer
+    size_t len = 0;
+    uint32_t n = 0;
+    char *r = NULL;
+
+    touch(w, end); // end may be unreached
+    if(w->binary) { // the ids are copied from the prev chain (via ext)
+        if(0 == (n = path_hops(w->v, start, end, VERT_IDX_MAX))) return NULL;
+        r = bin_reply(w, REPLY_PATH, sizeof(start), n, w->v[end].dist);
+        if(r) path_ids(w->v, ext, end, r + sizeof(bin_reply_t), n);
+        return r;
+    }
+    len = path_len(w->v, ext, start, end, VERT_IDX_MAX);
+    if(0 == len || 0 != buf_reserve(&w->path, len)) return NULL;
+    path_put(w->v, ext, start, end, w->path.p, len);
+    return w->path.p;
+}
+
+char * wgen_path( scratch_t *w
+                , uint32_t start
+                , uint32_t end
+                )
+{
+    size_t len = 0;
+    uint32_t n = 0;
+    char *r = NULL;
+
+    wtouch_v(w->wv, w->epoch, end); // end may be unreached
+    if(w->binary) {
+        if(0 == (n = wpath_hops(w->wv, start, end, w->wcap))) return NULL;
+        r = bin_reply(w, REPLY_PATH, sizeof(start), n, w->wv[end].dist);
+        if(r) wpath_ids(w->wv, NULL, end, r + sizeof(bin_reply_t), n);
+        return r;
+    }
+    len = wpath_len(w->wv, NULL, start, end, w->wcap);
+    if(0 == len || 0 != buf_reserve(&w->path, len)) return NULL;
+    wpath_put(w->wv, NULL, start, end, w->path.p, len);
+    return w->path.p;
+}
+
+char * no_path( scratch_t *w
+              , uint32_t start
+              , uint32_t end
+              )
+{
+    if(w->binary) return bin_reply(w, REPLY_NO_PATH, 0, 0, 0);
+    if(0 != buf_reserve(&w->path, 64)) return NULL;
+    snprintf(w->path.p, w->path.cap, "No path from '%u' to '%u'\n", start, end);
+    return w->path.p;
+}
+
+char * solve( scratch_t *w
+            , const graph_t *g
+            , uint16_t start
+            , uint16_t end
+            , int algo
+            )
+{
+    char *path = NULL;
+    uint64_t t = metrics_now(), t_path = 0;
+    uint16_t s = graph_vert(g, start), e = graph_vert(g, end);
+
+    scratch_next_epoch(w);
+    memset(&w->h.st, 0, sizeof(w->h.st));
+    memset(&w->hb.st, 0, sizeof(w->hb.st));
+    memset(&w->bq.st, 0, sizeof(w->bq.st));
+    if(ALGO_CH == algo && 0 == g->ch.n_vert) algo = ALGO_BIDIR;
+    if(ALGO_ALT == algo && 0 == g->alt.k) algo = ALGO_DIJKSTRA;
+    if(ALGO_CH == algo) chdijkstras(g, w, s, e);
+    else if(ALGO_BIDIR == algo) bidijkstras(g, w, s, e);
+    else if(ALGO_ALT == algo) altdijkstras(g, w, s, e);
+    else if(QUEUE_BUCKET == w->queue
+         || (QUEUE_AUTO == w->queue && g->max_cost < BUCKET_AUTO_MAX)) {
+        dials(g, w, s, e);
+    }
+    else dijkstras(g, w, s, e);
+    t_path = metrics_now();
+    solve_metrics(&w->m, algo, (qstat_t[]){ w->h.st, w->hb.st, w->bq.st }, 3);
+    hist_add(&w->m.phase[PHASE_SEARCH], t_path - t);
+    path = gen_path(w, g->to_ext, s, e);
+    hist_add(&w->m.phase[PHASE_PATH], metrics_now() - t_path);
+    return path ? path : no_path(w, start, end);
+}
+
+char * wsolve( scratch_t *w
+             , const wgraph_t *g
+             , uint32_t start
+             , uint32_t end
+             )
+{
+    char *path = NULL;
+    uint64_t t = 0, t_path = 0;
+
+    if(0 == start || 0 == end || start >= g->n_ids || end >= g->n_ids) {
+        return no_path(w, start, end);
+    }
+    if(0 != scratch_wide(w, g->n_ids)) return NULL;
+    t = metrics_now();
+    scratch_next_epoch(w);
+    memset(&w->wh.st, 0, sizeof(w->wh.st));
+    wcsr_dijkstras(g->n_vert, g->off, g->dest, g->cost, w->wv, &w->wh
+                  , w->epoch
+                  , start
+                  , end
+                  );
+    t_path = metrics_now();
+    solve_metrics(&w->m, ALGO_DIJKSTRA, &w->wh.st, 1);
+    hist_add(&w->m.phase[PHASE_SEARCH], t_path - t);
+    path = wgen_path(w, start, end);
+    hist_add(&w->m.phase[PHASE_PATH], metrics_now() - t_path);
+    return path ? path : no_path(w, start, end);
+}
@@ -0,0 +1,676 @@
+/* Shortest Path Solver for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ch.h"
+#include "alt.h"
+#include "metrics.h"
+
+/* The solver: graphs in CSR layout, the scratch space of a search, the
+ * searches and the replies they produce. It has no sockets and no shared
+ * state beyond the tunables and counters below, so the server and the
+ * benchmark (util/bench.c) link the same code.
+ */
+#define VERT_IDX_MAX 65536 /* Valid indices: 1-65535; invalid index: 0 */
+#define WIDE_ID_MAX (1u << 26) /* Vertices a wide graph may have */
+
+// Wide graph: 32-bit vertex ids and costs in the CSR layout of graph_t, for
+// graphs beyond VERT_IDX_MAX vertices; searched by Dijkstra only
+typedef struct {
+    uint32_t n_vert;  // number of vertices with an entry in off
+    uint32_t n_ids;   // number of vertices a search needs (1 + largest id)
+    uint32_t n_edge;  // number of entries in dest and cost
+    uint32_t *off;    // n_vert+1 offsets into dest/cost; owns the allocation
+    uint32_t *dest;
+    uint32_t *cost;
+    size_t cap;       // bytes allocated at off (0 if mapped)
+} wgraph_t;
+
+// Directed graph in compressed-sparse-row layout. The outbound edges of
+// vertex i are dest[off[i]] .. dest[off[i+1]-1] (cost is laid out the same)
+// Vertices >= n_vert have no outbound edges and no entry in off
+typedef struct {
+    uint32_t n_vert;  // number of vertices with an entry in off
+    uint32_t n_edge;  // number of entries in dest and cost
+    uint32_t *off;    // n_vert+1 offsets into dest/cost; owns the allocation
+    uint16_t *dest;   // The index of the destination of each edge
+    uint16_t *cost;   // The cost to follow each edge to dest
+    size_t cap;       // bytes allocated at off; reused by later builds
+                      // (0 if the arrays point into a mapped graph file)
+    // Reverse adjacency for searches toward the end vertex; only valid if
+    // has_rev. The inbound edges of vertex i come from rsrc[roff[i]] ..
+    // rsrc[roff[i+1]-1]; vertices >= rn_vert have no inbound edges
+    int has_rev;
+    uint32_t rn_vert;
+    uint32_t *roff;   // rn_vert+1 offsets; owns the reverse allocation
+    uint16_t *rsrc;   // The index of the source of each inbound edge
+    uint16_t *rcost;  // The cost to follow each inbound edge
+    size_t rcap;      // bytes allocated at roff (0 if mapped)
+    ch_t ch;          // contraction hierarchy; ch.n_vert is 0 if none
+    alt_t alt;        // ALT landmarks; alt.k is 0 if none
+    uint16_t max_cost; // largest edge cost; sizes the bucket queue
+    wgraph_t *wide;   // resident wide graph; the fields above are then empty
+    uint32_t ver;     // OP_UPDATE batches applied since it became resident
+    // Vertex numbering of a graph renumbered by graph_reorder(), or NULL:
+    // the vertices are the ids of the requests. Each is VERT_IDX_MAX
+    // entries; to_ext owns the allocation, which the OP_UPDATE versions of
+    // a resident graph share
+    uint16_t *to_ext; // id of each vertex
+    uint16_t *to_int; // vertex of each id
+} graph_t;
+
+// Vertex numbering of graph_reorder()
+enum {
+    ORDER_NONE = 0,   // the ids of the requests
+    ORDER_BFS = 1,    // breadth-first from each unnumbered vertex in id order
+    ORDER_RCM = 2,    // reverse Cuthill-McKee: breadth-first from the least
+                      // connected unnumbered vertex, neighbours by degree,
+                      // then reversed
+    ORDER_DEGREE = 3  // by decreasing degree, so hubs share cache lines
+};
+
+// Returns the vertex of id i of the graph (see graph_reorder)
+static inline uint16_t graph_vert( const graph_t *g
+                                 , uint16_t i
+                                 )
+{
+    return g->to_int ? g->to_int[i] : i;
+}
+
+// Returns the id of vertex i of the graph
+static inline uint16_t graph_id( const graph_t *g
+                               , uint16_t i
+                               )
+{
+    return g->to_ext ? g->to_ext[i] : i;
+}
+
+// Filter of 8 compact relaxations (see relax_range in search.h); the best
+// kernel the CPU supports is picked by relax_init(), NULL for scalar
+typedef uint32_t (*relax8_fn)( const void *v
+                             , uint32_t epoch
+                             , uint32_t dist
+                             , const uint16_t *dest
+                             , const uint16_t *cost
+                             );
+extern relax8_fn relax8;
+
+// Vertices, heaps and CSR searches at each width; see search.h
+#define SEARCH_VID uint16_t
+#define SEARCH_COST uint16_t
+#define SEARCH_DIST uint32_t
+#define SEARCH(x) x
+#define SEARCH_RELAX8 relax8
+#include "search.h"
+
+#define SEARCH_VID uint32_t
+#define SEARCH_COST uint32_t
+#define SEARCH_DIST uint64_t
+#define SEARCH(x) w##x
+#include "search.h"
+
+// Dial's bucket queue of vertex indices. Queued distances span at most
+// max_cost+1 values, so bucket dist % n_bucket holds exactly one distance;
+// each bucket is a doubly-linked list threaded through next/prev (0: none)
+typedef struct {
+    uint16_t *head; // BUCKET_MAX buckets; only 0..n_bucket-1 are used
+    uint16_t *next; // VERT_IDX_MAX links to the next vertex in the bucket
+    uint16_t *prev; // VERT_IDX_MAX links to the previous vertex in the bucket
+    qstat_t st;     // operations since last cleared
+} bucketq_t;
+#define BUCKET_MAX 65536 // max_cost + 1 of 16-bit costs
+
+// Priority queue engine of one-directional searches
+enum {
+    QUEUE_AUTO = 0, // bucket queue if the graph's max cost < BUCKET_AUTO_MAX
+    QUEUE_HEAP = 1,
+    QUEUE_BUCKET = 2
+};
+#define BUCKET_AUTO_MAX 4096
+
+// Search algorithm of solve()
+enum {
+    ALGO_DIJKSTRA = 0, // one-directional search from the start vertex
+    ALGO_BIDIR = 1,    // bidirectional search meeting in the middle
+    ALGO_CH = 2,       // contraction hierarchy query; graphs without one
+                       // fall back to ALGO_BIDIR
+    ALGO_ALT = 3,      // A* search with landmark bounds; graphs without
+                       // landmarks fall back to ALGO_DIJKSTRA
+    ALGO_N
+};
+
+// A problem is a 6-byte header and edges of 3 2-byte values
+#define MSG_HDR_SZ 6 // start, end & edge count
+#define MSG_REC_SZ 6 // source, sync & cost
+
+// A wide problem is a problem with 4-byte start, end & count, and edges of
+// 3 4-byte values; it can name vertices beyond VERT_IDX_MAX
+#define MSG_WHDR_SZ 12 // start, end & edge count
+#define MSG_WREC_SZ 12 // source, sync & cost
+#define WIDE_EDGE_MAX (1u << 26) // edges a wide problem may have
+#define WBUILD_PAR_MIN (1u << 16) // edges before a wide build is threaded
+
+// csr_count() of the first n_rec edge records of a wide problem
+typedef struct {
+    uint64_t n_vert;
+    uint64_t n_ids;
+    uint32_t n_edge;
+    uint32_t n_rec;
+} csr_sizes_t;
+
+// Binary reply of a SESSION_BINARY session, in host byte order like the
+// requests. The n_vert ids of the path follow it, start first; each is
+// width bytes (2, or 4 for wide graphs). It is never NUL-terminated
+typedef struct {
+    uint8_t status;  // REPLY_*
+    uint8_t width;   // bytes per vertex id
+    uint16_t pad;
+    uint32_t n_vert; // vertices on the path, start & end included
+    uint64_t dist;   // distance of the path; the graph id of REPLY_LOADED
+} bin_reply_t;
+enum {
+    REPLY_PATH = 0,     // a shortest path
+    REPLY_NO_PATH = 1,  // no path from start to end
+    REPLY_NO_GRAPH = 2, // the queried graph id isn't resident
+    REPLY_LOADED = 3,   // an upload is resident
+    REPLY_MATRIX = 4,   // n_vert 4-byte distances of an OP_MATRIX, row by
+                        // row (dist holds the row length); see matrix_reply
+    REPLY_TREE = 5,     // n_vert tree_rec_t of an OP_TREE (dist holds the
+                        // start)
+    REPLY_BUSY = 6      // the server is overloaded; the request wasn't run
+};
+
+// Growable buffer; only ever grows so steady state requests don't allocate
+typedef struct {
+    char *p;
+    size_t cap;
+} buf_t;
+
+// Bytes received on a connection. The message being parsed starts at off;
+// any bytes after it belong to messages pipelined behind it
+typedef struct {
+    buf_t b;
+    size_t off; // start of the current message
+    size_t len; // end of the bytes received
+} inbuf_t;
+
+// Per-worker scratch space reused across requests. Traversal state is reset
+// lazily: bumping epoch invalidates every vertex without touching memory
+typedef struct {
+    vertex_t *v;    // VERT_IDX_MAX vertices; v[0] is unused
+    heap_t h;       // priority queue; holds indices into v
+    vertex_t *vb;   // backward search vertices of bidirectional searches;
+                    // prev is the next vertex toward the end
+    heap_t hb;      // backward search priority queue; holds indices into vb
+    wvertex_t *wv;  // wcap vertices of wide searches; grown on demand
+    wheap_t wh;     // wide search priority queue; holds indices into wv
+    uint32_t wcap;
+    bucketq_t bq;   // bucket queue alternative to h; holds indices into v
+    uint32_t *mark; // VERT_IDX_MAX epochs; a target of the current search
+                    // if it matches epoch
+    int queue;      // QUEUE_* engine of one-directional searches
+    uint32_t epoch; // generation of the current request
+    buf_t path;     // reply string of the current request
+    int binary;     // the current request is answered with a bin_reply_t
+    size_t reply_len; // bytes of a binary reply in path
+    graph_t g;      // graph of the current message
+    wgraph_t wg;    // wide graph of the current message
+    metrics_t m;    // metrics of the thread; solve() records its searches
+    // Server state of the current message; the solver never touches it
+    inbuf_t in;     // bytes received from the current blocking client
+    buf_t tree;     // cached shortest path tree of the current request
+    uint64_t rcu;   // resident_gen when the current message was received;
+                    // 0 between messages (see serve_msg in main.c)
+    uint32_t node;  // NUMA node of the thread (see resident_local in main.c)
+} scratch_t;
+
+extern uint32_t build_threads; // threads of a large wide build (-t)
+
+// Returns the forward search vertex i of the current request
+static inline vertex_t * touch( scratch_t *w
+                              , uint16_t i
+                              )
+{
+    return touch_v(w->v, w->epoch, i);
+}
+
+// Picks the relax8 kernel of the CPU; scalar if none fits the vertex layout
+void relax_init(void);
+
+/* Ensure the buffer can hold at least sz bytes
+ *
+ * Guarantees:
+ *   - The buffer is grown (contents are preserved) if it is too small
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the allocation fails
+ */
+int buf_reserve( buf_t *b
+               , size_t sz
+               );
+
+/* Allocate the per-worker scratch space
+ *
+ * Requires:
+ *   - The heap arity to use: 2, 4 or 8
+ *   - The queue engine to use: QUEUE_AUTO, QUEUE_HEAP or QUEUE_BUCKET
+ *
+ * Guarantees:
+ *   - The vertex and queue arrays are allocated and zeroed once
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int scratch_init( scratch_t *w
+                , int arity
+                , int queue
+                );
+
+// Releases everything owned by the scratch space
+void scratch_destroy(scratch_t *w);
+
+// Starts a new request; all vertices become untouched (infinite distance)
+void scratch_next_epoch(scratch_t *w);
+
+/* Make room for wide searches of n vertices
+ *
+ * Guarantees:
+ *   - wv and wh hold at least n vertices; new vertices are untouched
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the allocation fails
+ */
+int scratch_wide( scratch_t *w
+                , uint32_t n
+                );
+
+/* Build a CSR graph from an array of 6-byte edge records
+ *
+ * Requires:
+ *   - An array of n records; each is 3 uint16_t (source, sync, cost)
+ *   - A reference to a graph_t to store the result
+ *
+ * Guarantees:
+ *   - The records are laid out by csr_scatter() (see search.h): edges of a
+ *     vertex keep their record order and records naming vertex 0 (the
+ *     invalid index) are dropped
+ *   - max_cost is the largest cost of the edges kept
+ *   - off, dest & cost share one allocation; free(g->off) releases it
+ *   - An existing allocation in g is reused if it is large enough
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int build_csr( graph_t *g
+             , const uint16_t *rec
+             , uint32_t n
+             );
+
+/* Build the reverse adjacency of a CSR graph
+ *
+ * Requires:
+ *   - A graph built by build_csr (or mapped)
+ *
+ * Guarantees:
+ *   - Inbound edges are counted per destination, prefix-summed into roff and
+ *     scattered into rsrc/rcost; they keep the order of the forward arrays
+ *   - An existing reverse allocation in g is reused if it is large enough
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int build_rev(graph_t *g);
+
+/* Renumber the vertices of a graph for locality
+ *
+ * Requires:
+ *   - A compact graph with its reverse adjacency, not renumbered yet and
+ *     without a contraction hierarchy or landmarks (build them afterwards)
+ *   - The ORDER_* numbering
+ *
+ * Guarantees:
+ *   - Vertices with edges are numbered 1.. in the order, treating edges as
+ *     undirected, so the neighbours a search relaxes are near each other in
+ *     the vertex array; ids without edges follow in id order
+ *   - The CSR arrays (and reverse adjacency) are rebuilt in the numbering;
+ *     edges of a vertex keep their order and a mapped graph is copied
+ *   - to_ext and to_int translate; searches run on vertices, requests and
+ *     replies carry ids (see graph_vert, graph_id and gen_path)
+ *   - ORDER_NONE leaves the graph as it is
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error; the graph is left as it was
+ */
+int graph_reorder( graph_t *g
+                 , int order
+                 );
+
+/* Copy the CSR arrays of a graph into new allocations
+ *
+ * Requires:
+ *   - A built or mapped graph, compact or wide
+ *   - A reference to a graph_t to store the copy
+ *
+ * Guarantees:
+ *   - The forward and reverse adjacency (or the wide graph) are copied by
+ *     the calling thread, so first-touch places their pages on its NUMA node
+ *   - The contraction hierarchy and landmarks are shared with src, which
+ *     must outlive the copy
+ *   - 0 will be returned on success; graph_copy_free() releases the copy
+ *   - -1 will be returned if an allocation fails (dst holds nothing)
+ */
+int graph_copy( graph_t *dst
+              , const graph_t *src
+              );
+
+// Releases the arrays of a graph_copy(); its ch and alt are left alone
+void graph_copy_free(graph_t *g);
+
+/* Build a wide CSR graph from an array of 12-byte edge records
+ *
+ * Requires:
+ *   - An array of n records; each is 3 uint32_t (source, sync, cost)
+ *   - The records' csr_count() if the parser took it while they were
+ *     received (see parse_msg), or NULL
+ *   - A reference to a wgraph_t to store the result
+ *
+ * Guarantees:
+ *   - The records are laid out like build_csr() lays them out
+ *   - Builds of WBUILD_PAR_MIN records or more are split over build_threads
+ *     threads (see wbuild_par)
+ *   - off, dest & cost share one allocation; free(g->off) releases it
+ *   - An existing allocation in g is reused if it is large enough
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (including ids of WIDE_ID_MAX or more)
+ */
+int wbuild_csr( wgraph_t *g
+              , const char *rec
+              , uint32_t n
+              , const csr_sizes_t *pre
+              );
+
+/* Load the graph from a received problem
+ *
+ * Requires:
+ *   - A complete problem (OP_PROBLEM) or upload (OP_LOAD) as accepted by
+ *     parse_msg; the start & end of an upload are meaningless
+ *   - A reference to a graph_t to store the data
+ *
+ * Guarantees:
+ *   - The edges will be loaded into the graph (see build_csr)
+ *   - The start & end vertex ids will be set
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int load_map( const char *msg
+            , graph_t *g
+            , uint16_t *start
+            , uint16_t *end
+            );
+
+// load_map() of a wide problem (OP_WSOLVE or OP_WLOAD, after the extended
+// header) whose records the parser may have sized; see wbuild_csr
+int load_wmap( const char *msg
+             , const csr_sizes_t *pre
+             , wgraph_t *g
+             , uint32_t *start
+             , uint32_t *end
+             );
+
+/* Performs Dijkstra's Algorithm on the provided vertices
+ *
+ * Requires:
+ *   - A graph to search is provided
+ *   - Scratch space whose epoch was advanced for this request
+ *     - 0 dist indicates infinity
+ *   - A start index into the array of vertices is provided
+ *   - An end index into the array of vertices is provided
+ *
+ * Guarantees:
+ *   - The search of csr_dijkstras() (see search.h) on the scratch space's
+ *     forward vertices and heap
+ *   - The distance from start to end is returned (0 for no path)
+ */
+int dijkstras( const graph_t *g
+             , scratch_t *w
+             , uint16_t start
+             , uint16_t end
+             );
+
+/* Performs Dijkstra's Algorithm from one vertex to many
+ *
+ * Requires:
+ *   - A graph to search is provided
+ *   - Scratch space whose epoch was advanced for this request
+ *   - A start index into the array of vertices is provided
+ *   - n targets as an unaligned array of ids of the graph (see graph_vert);
+ *     none (n = 0) searches every vertex reachable from start
+ *
+ * Guarantees:
+ *   - The search stops once every distinct target is settled
+ *   - The distance and prev chain of each target reached are in v, as
+ *     after dijkstras() to that target
+ *   - The search is added to the scratch space's metrics like one of
+ *     solve()
+ */
+void dijkstras_many( const graph_t *g
+                   , scratch_t *w
+                   , uint16_t start
+                   , const char *targets
+                   , uint32_t n
+                   );
+
+/* Performs Dijkstra's Algorithm with Dial's bucket queue
+ *
+ * Requires:
+ *   - A graph to search is provided; its max_cost sizes the buckets
+ *   - Scratch space whose epoch was advanced for this request
+ *     - 0 dist indicates infinity
+ *   - A start index into the array of vertices is provided
+ *   - An end index into the array of vertices is provided
+ *
+ * Guarantees:
+ *   - The same search as dijkstras(), except that the queue is max_cost+1
+ *     circular buckets scanned in distance order: push, decrease-key and
+ *     pop are O(1), plus one step per empty bucket passed
+ *   - The distance from start to end is returned (0 for no path)
+ *   - The buckets are left empty for the next request
+ */
+int dials( const graph_t *g
+         , scratch_t *w
+         , uint16_t start
+         , uint16_t end
+         );
+
+/* Performs a bidirectional Dijkstra search on the provided vertices
+ *
+ * Requires:
+ *   - A graph with its reverse adjacency (has_rev)
+ *   - Scratch space whose epoch was advanced for this request
+ *     - 0 dist indicates infinity
+ *   - A start index and an end index into the array of vertices
+ *
+ * Guarantees:
+ *   - A forward search from start (v) and a backward search from end (vb)
+ *     alternate, expanding whichever frontier is closer; each relaxation
+ *     that reaches a vertex settled or queued by the other side updates the
+ *     best known path through it
+ *   - The searches stop once the two frontier minimums add up to at least
+ *     the best path, which is then a shortest path
+ *   - The backward half is stitched into the forward prev chain, so
+ *     gen_path() reads the whole path from v as after dijkstras()
+ *   - The distance from start to end is returned (0 for no path)
+ *   - The queues are left empty for the next request
+ */
+int bidijkstras( const graph_t *g
+               , scratch_t *w
+               , uint16_t start
+               , uint16_t end
+               );
+
+/* Performs a contraction hierarchy query on the provided vertices
+ *
+ * Requires:
+ *   - A graph with a contraction hierarchy (ch.n_vert != 0)
+ *   - Scratch space whose epoch was advanced for this request
+ *     - 0 dist indicates infinity
+ *   - A start index and an end index into the array of vertices
+ *
+ * Guarantees:
+ *   - A forward search from start over the up arcs (v) and a backward
+ *     search from end over the dn arcs (vb) only climb in rank; each side
+ *     stops once its frontier can't beat the best meeting vertex
+ *   - The path through the best meeting vertex is unpacked into graph
+ *     edges on the forward prev chain, so gen_path() reads it from v as
+ *     after dijkstras()
+ *   - The distance from start to end is returned (0 for no path)
+ *   - The queues are left empty for the next request
+ */
+int chdijkstras( const graph_t *g
+               , scratch_t *w
+               , uint16_t start
+               , uint16_t end
+               );
+
+/* Performs an A* search with ALT bounds on the provided vertices
+ *
+ * Requires:
+ *   - A graph with landmarks (alt.k != 0)
+ *   - Scratch space whose epoch was advanced for this request
+ *     - 0 dist indicates infinity
+ *   - A start index and an end index into the array of vertices
+ *
+ * Guarantees:
+ *   - The search of dijkstras() with each vertex keyed by its distance plus
+ *     its bound to end (alt_bound), so the heap settles vertices toward end
+ *     first; vertices the landmarks prove can't reach end are never queued
+ *   - While searching, v[i].dist is the key; vb[i].dist is the bound, valid
+ *     if vb[i].visited. Keys saturate at UINT32_MAX, past any reply distance
+ *   - The bound of end is 0, so v[end].dist is its distance, and gen_path()
+ *     reads the path from v as after dijkstras()
+ *   - The distance from start to end is returned (0 for no path)
+ *   - The queue is left empty for the next request
+ */
+int altdijkstras( const graph_t *g
+                , scratch_t *w
+                , uint16_t start
+                , uint16_t end
+                );
+
+/* Start a binary reply in the scratch path buffer
+ *
+ * Guarantees:
+ *   - The header is filled in and room is made for n ids of width bytes
+ *   - reply_len is the size of the header and the ids
+ *   - The reply will be returned; NULL on allocation failure
+ */
+char * bin_reply( scratch_t *w
+                , uint8_t status
+                , uint8_t width
+                , uint32_t n
+                , uint64_t dist
+                );
+
+/* Get's the path from start to end for the listed vertices, if any
+ *
+ * Requires:
+ *   - Scratch space with an accessible .dist member for each vertex
+ *     - 0 dist indicates infinity
+ *   - The vertices have been processed via dijkstras()
+ *   - The graph's to_ext, which the ids of the path are replied in, or NULL
+ *   - A start index into the array of vertices is provided
+ *   - An end index into the array of vertices is provided
+ *
+ * Guarantess:
+ *   - A string containing the path & distance will be returned if a path exists
+ *     - The string lives in the scratch path buffer until the next request
+ *     - It is a REPLY_PATH bin_reply_t if the request is binary
+ *   - NULL will be returned if no path exists
+ */
+char * gen_path( scratch_t *w
+               , const uint16_t *ext
+               , uint16_t start
+               , uint16_t end
+               );
+
+// gen_path() of a wide search, whose vertices are in wv
+char * wgen_path( scratch_t *w
+                , uint32_t start
+                , uint32_t end
+                );
+
+// Returns the reply stating there is no path from start to end, or NULL on
+// allocation failure
+char * no_path( scratch_t *w
+              , uint32_t start
+              , uint32_t end
+              );
+
+/* Solves a shortest path problem on the provided graph
+ *
+ * Requires:
+ *   - Scratch space initialized with scratch_init()
+ *   - The graph: loaded into the scratch space via load_map or resident
+ *     - ALGO_BIDIR and ALGO_CH need the graph's reverse adjacency
+ *   - The start & end vertex ids of the problem; ids of a renumbered graph
+ *     are translated both ways (see graph_reorder)
+ *   - The search algorithm (ALGO_*); the scratch space's queue engine
+ *     picks the queue of ALGO_DIJKSTRA
+ *
+ * Guarantees:
+ *   - The search, the vertices it settled, the edges it scanned and its
+ *     queue operations are added to the scratch space's metrics under the
+ *     algorithm that ran; the search and gen_path() are timed as
+ *     PHASE_SEARCH and PHASE_PATH
+ *   - A string containing the shortest path and distance, if one exists
+ *   - A string stating there is no path, if none exists
+ *   - The string lives in the scratch space until the next request
+ *   - NULL on allocation failure
+ */
+char * solve( scratch_t *w
+            , const graph_t *g
+            , uint16_t start
+            , uint16_t end
+            , int algo
+            );
+
+/* Solves a shortest path problem on the provided wide graph
+ *
+ * Requires:
+ *   - Scratch space initialized with scratch_init()
+ *   - The wide graph: loaded into the scratch space via load_wmap or resident
+ *   - The start & end vertex ids of the problem
+ *
+ * Guarantees:
+ *   - The reply of solve(), found by Dijkstra's Algorithm on the wide
+ *     vertices & heap; every algorithm and queue engine maps to it, and
+ *     it is counted as ALGO_DIJKSTRA
+ *   - Ids the graph doesn't have (0 or beyond n_ids) have no path
+ *   - NULL on allocation failure
+ */
+char * wsolve( scratch_t *w
+             , const wgraph_t *g
+             , uint32_t start
+             , uint32_t end
+             );
+
+#endif // SOLVER_H
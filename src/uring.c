@@ -0,0 +1,336 @@
+/* io_uring Rings for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+
+// Maps a ring area of the fd; NULL on error
+static void * ring_map( int fd
+                      , size_t len
+                      , uint64_t off
+                      )
+{
+    void *p = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE
+                  , fd, off);
+    return MAP_FAILED == p ? NULL : p;
+}
+
+int uring_init( uring_t *r
+              , uint32_t entries
+              )
+{
+    struct io_uring_params p;
+    int err = 0;
+
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_COOP_TASKRUN; // no IPI to run completions early
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if(-1 == r->fd && EINVAL == errno) { // before 5.19
+        memset(&p, 0, sizeof(p));
+        r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    }
+    if(-1 == r->fd) return -1;
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) { // one mapping holds both rings
+        if(r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+        r->cq_len = 0;
+    }
+    r->sq_map = ring_map(r->fd, r->sq_len, IORING_OFF_SQ_RING);
+    r->cq_map = r->cq_len ? ring_map(r->fd, r->cq_len, IORING_OFF_CQ_RING)
+                          : r->sq_map;
+    r->sqes = ring_map(r->fd, r->sqes_len, IORING_OFF_SQES);
+    if(!r->sq_map || !r->cq_map || !r->sqes) goto error;
+    r->sq_entries = p.sq_entries;
+    r->sq_mask = *(uint32_t *)((char *)r->sq_map + p.sq_off.ring_mask);
+    r->sq_head = (uint32_t *)((char *)r->sq_map + p.sq_off.head);
+    r->sq_ktail = (uint32_t *)((char *)r->sq_map + p.sq_off.tail);
+    r->sq_array = (uint32_t *)((char *)r->sq_map + p.sq_off.array);
+    r->sq_tail = *r->sq_ktail;
+    r->cq_mask = *(uint32_t *)((char *)r->cq_map + p.cq_off.ring_mask);
+    r->cq_head = (uint32_t *)((char *)r->cq_map + p.cq_off.head);
+    r->cq_tail = (uint32_t *)((char *)r->cq_map + p.cq_off.tail);
+    r->cqes = (char *)r->cq_map + p.cq_off.cqes;
+    return 0;
+error:
+    err = errno;
+    uring_destroy(r);
+    errno = err;
+    return -1;
+}
+
+void uring_destroy(uring_t *r)
+{
+    if(r->sqes) munmap(r->sqes, r->sqes_len);
+    if(r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_len);
+    if(r->sq_map) munmap(r->sq_map, r->sq_len);
+    if(-1 != r->fd) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+// Makes room for n more operations, submitting the queued ones if need be;
+// 0, or -1 if the kernel hasn't taken enough of them
+static int sq_room( uring_t *r
+                  , uint32_t n
+                  )
+{
+    uint32_t head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+    if(r->sq_tail - head + n <= r->sq_entries) return 0;
+    if(0 != uring_submit(r, 0) && EINTR != errno) return -1;
+    head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if(r->sq_tail - head + n <= r->sq_entries) return 0;
+    errno = EBUSY;
+    return -1;
+}
+
+// Returns the cleared entry of the next submission slot (see sq_room)
+static struct io_uring_sqe * sq_next( uring_t *r
+                                    , uint8_t op
+                                    , int fd
+                                    , uint64_t data
+                                    )
+{
+    uint32_t i = r->sq_tail++ & r->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)r->sqes + i;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->user_data = data;
+    r->sq_array[i] = i;
+    return sqe;
+}
+
+// Points an entry at a buffer; lengths past 32 bits are cut short
+static void sqe_buf( struct io_uring_sqe *sqe
+                   , const void *buf
+                   , size_t len
+                   )
+{
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = len > UINT32_MAX ? UINT32_MAX : len;
+}
+
+int uring_accept( uring_t *r
+                , int fd
+                , uint64_t data
+                )
+{
+    if(0 != sq_room(r, 1)) return -1;
+    sq_next(r, IORING_OP_ACCEPT, fd, data)->ioprio = IORING_ACCEPT_MULTISHOT;
+    return 0;
+}
+
+int uring_recv( uring_t *r
+              , int fd
+              , void *buf
+              , size_t len
+              , uint64_t data
+              )
+{
+    if(0 != sq_room(r, 1)) return -1;
+    sqe_buf(sq_next(r, IORING_OP_RECV, fd, data), buf, len);
+    return 0;
+}
+
+int uring_send( uring_t *r
+              , int fd
+              , const void *buf
+              , size_t len
+              , uint64_t data
+              )
+{
+    struct io_uring_sqe *sqe = NULL;
+
+    if(0 != sq_room(r, 1)) return -1;
+    sqe = sq_next(r, IORING_OP_SEND, fd, data);
+    sqe_buf(sqe, buf, len);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    return 0;
+}
+
+int uring_send_close( uring_t *r
+                    , int fd
+                    , const void *buf
+                    , size_t len
+                    , uint64_t data
+                    , uint64_t close_data
+                    )
+{
+    if(0 != sq_room(r, 2)) return -1; // the link must not be split
+    uring_send(r, fd, buf, len, data);
+    ((struct io_uring_sqe *)r->sqes)[(r->sq_tail - 1) & r->sq_mask].flags
+        |= IOSQE_IO_LINK;
+    sq_next(r, IORING_OP_CLOSE, fd, close_data);
+    return 0;
+}
+
+int uring_read( uring_t *r
+              , int fd
+              , void *buf
+              , size_t len
+              , uint64_t data
+              )
+{
+    struct io_uring_sqe *sqe = NULL;
+
+    if(0 != sq_room(r, 1)) return -1;
+    sqe = sq_next(r, IORING_OP_READ, fd, data);
+    sqe_buf(sqe, buf, len);
+    sqe->off = (uint64_t)-1; // the file position, like read()
+    return 0;
+}
+
+int uring_submit( uring_t *r
+                , uint32_t wait
+                )
+{
+    uint32_t n = 0;
+
+    __atomic_store_n(r->sq_ktail, r->sq_tail, __ATOMIC_RELEASE);
+    n = r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if(0 == n && 0 == wait) return 0;
+    if(-1 == syscall( __NR_io_uring_enter, r->fd, n, wait
+                    , wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+int uring_next( uring_t *r
+              , uring_cqe_t *cqe
+              )
+{
+    uint32_t head = *r->cq_head; // only written here
+    const struct io_uring_cqe *c = NULL;
+
+    if(head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+    c = (const struct io_uring_cqe *)r->cqes + (head & r->cq_mask);
+    cqe->data = c->user_data;
+    cqe->res = c->res;
+    cqe->more = 0 != (c->flags & IORING_CQE_F_MORE);
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#else // !HAVE_IO_URING: no ring sets up, so the others are never reached
+
+int uring_init( uring_t *r
+              , uint32_t entries
+              )
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+void uring_destroy(uring_t *r)
+{
+    r->fd = -1;
+}
+
+int uring_accept( uring_t *r
+                , int fd
+                , uint64_t data
+                )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_recv( uring_t *r
+              , int fd
+              , void *buf
+              , size_t len
+              , uint64_t data
+              )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_send( uring_t *r
+              , int fd
+              , const void *buf
+              , size_t len
+              , uint64_t data
+              )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_send_close( uring_t *r
+                    , int fd
+                    , const void *buf
+                    , size_t len
+                    , uint64_t data
+                    , uint64_t close_data
+                    )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_read( uring_t *r
+              , int fd
+              , void *buf
+              , size_t len
+              , uint64_t data
+              )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_submit( uring_t *r
+                , uint32_t wait
+                )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_next( uring_t *r
+              , uring_cqe_t *cqe
+              )
+{
+    return 0;
+}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,152 @@
+/* io_uring Rings for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A minimal io_uring driven by the raw syscalls, so no liburing is needed.
+ * Operations are queued on the submission ring by uring_accept() and the
+ * like, which only write memory, and reach the kernel in one batch with the
+ * next uring_submit(); their completions are then taken from the completion
+ * ring by uring_next(). Each operation carries 64 bits of user data back in
+ * its completion. A ring is driven by one thread at a time. Without
+ * io_uring headers at build time (HAVE_IO_URING), uring_init() fails with
+ * ENOSYS
+ */
+typedef struct {
+    int fd;              // ring fd; -1 if not set up
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_tail;    // next submission slot; published on submit
+    uint32_t *sq_head;   // shared with the kernel
+    uint32_t *sq_ktail;
+    uint32_t *sq_array;
+    uint32_t cq_mask;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    void *sqes;          // struct io_uring_sqe of each submission slot
+    void *cqes;          // struct io_uring_cqe of each completion slot
+    void *sq_map;        // mappings of the rings and their lengths
+    void *cq_map;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+} uring_t;
+
+// A completion taken from the ring
+typedef struct {
+    uint64_t data; // user data of the operation
+    int32_t res;   // its result: what the syscall would return, or -errno
+    int more;      // a multishot operation goes on posting completions
+} uring_cqe_t;
+
+/* Set up a ring
+ *
+ * Requires:
+ *   - Room for the operations queued between two uring_submit() calls;
+ *     the kernel rounds it up to a power of 2
+ *
+ * Guarantees:
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (errno is set; ENOSYS if the kernel or
+ *     build lacks io_uring); fd is then -1
+ */
+int uring_init( uring_t *r
+              , uint32_t entries
+              );
+
+// Tears down a ring set up by uring_init(); in-flight operations are dropped
+void uring_destroy(uring_t *r);
+
+/* Queue an operation
+ *
+ * Guarantees:
+ *   - uring_accept: a multishot accept of the listener; every client is a
+ *     completion (res is its fd) until one comes without more
+ *   - uring_recv: a receive of up to len bytes straight into buf (res is the
+ *     bytes received, 0 on EOF)
+ *   - uring_send: a send of len bytes (res is the bytes sent); it only
+ *     completes short if the connection fails or len exceeds 32 bits
+ *   - uring_send_close: uring_send linked to a close of the fd, which only
+ *     runs if all of it was sent; otherwise the close completes -ECANCELED
+ *   - uring_read: a read of up to len bytes into buf
+ *   - Queued operations that don't fit are submitted first
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the ring stays full (errno is set)
+ */
+int uring_accept( uring_t *r
+                , int fd
+                , uint64_t data
+                );
+
+int uring_recv( uring_t *r
+              , int fd
+              , void *buf
+              , size_t len
+              , uint64_t data
+              );
+
+int uring_send( uring_t *r
+              , int fd
+              , const void *buf
+              , size_t len
+              , uint64_t data
+              );
+
+int uring_send_close( uring_t *r
+                    , int fd
+                    , const void *buf
+                    , size_t len
+                    , uint64_t data
+                    , uint64_t close_data
+                    );
+
+int uring_read( uring_t *r
+              , int fd
+              , void *buf
+              , size_t len
+              , uint64_t data
+              );
+
+/* Submit the queued operations and wait for completions
+ *
+ * Guarantees:
+ *   - Every queued operation is handed to the kernel in one syscall
+ *   - Waits until at least wait completions are ready (0 doesn't wait)
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error (errno is set; EINTR, EAGAIN and EBUSY
+ *     are transient: take the ready completions and submit again)
+ */
+int uring_submit( uring_t *r
+                , uint32_t wait
+                );
+
+// Takes the next completion into cqe; returns 1, or 0 if none is ready
+int uring_next( uring_t *r
+              , uring_cqe_t *cqe
+              );
+
+#endif // URING_H
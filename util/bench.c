@@ -0,0 +1,339 @@
+/* Solver Benchmark for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/solver.h"
+#include "tool.h"
+
+#define OP_WLOAD 5 // extended requests with a wide problem (see src/main.c)
+#define OP_WSOLVE 6
+#define MSG_EXT_SZ 4
+
+// Queue engines compared on the compact layout
+static const struct {
+    const char *name;
+    int arity;
+    int queue;
+} engines[] = { { "heap2", 2, QUEUE_HEAP }
+              , { "heap4", 4, QUEUE_HEAP }
+              , { "heap8", 8, QUEUE_HEAP }
+              , { "bucket", 2, QUEUE_BUCKET }
+              };
+#define N_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+// A map under test: its edge records in both layouts, and the queries
+typedef struct {
+    const char *rec;      // compact records, or NULL if the map is wide
+    char *wrec;           // wide records (owned)
+    uint32_t n_rec;
+    uint32_t n_ids;       // 1 + largest vertex id
+    uint32_t *pairs;      // n_pairs start & end ids
+    uint32_t n_pairs;
+    int reps;
+} bench_t;
+
+/* Find the records of a problem or wide problem
+ *
+ * Requires:
+ *   - A map file as sent to the server: a problem, or an OP_WLOAD or
+ *     OP_WSOLVE with a wide problem (see util/gen_input_data.c)
+ *
+ * Guarantees:
+ *   - rec (compact) or wrec (wide) is set, with n_rec and n_ids
+ *   - A compact map's records are also widened into wrec, so both layouts
+ *     search the same graph
+ *   - 0 will be returned on success
+ *   - -1 will be returned if the map isn't one of those or is truncated
+ */
+int bench_map( bench_t *b
+             , char *msg
+             , long len
+             )
+{
+    uint64_t n_vert = 0, n_ids = 0;
+    uint32_t n_edge = 0, i = 0, hdr[3] = {0};
+    uint16_t h[3] = {0};
+
+    if(len < MSG_HDR_SZ) return -1;
+    memcpy(h, msg, sizeof(h));
+    if(0 != h[0]) { // a problem
+        if(MSG_HDR_SZ + (long)h[2] * MSG_REC_SZ > len) return -1;
+        b->rec = msg + MSG_HDR_SZ;
+        b->n_rec = h[2];
+        b->wrec = malloc((size_t)b->n_rec * MSG_WREC_SZ + 1);
+        if(!b->wrec) return -1;
+        for(i = 0; i < b->n_rec * 3; ++i) {
+            uint16_t x = 0;
+            uint32_t y = 0;
+            memcpy(&x, b->rec + i * sizeof(x), sizeof(x));
+            y = x;
+            memcpy(b->wrec + i * sizeof(y), &y, sizeof(y));
+        }
+        csr_count(b->rec, b->n_rec, &n_vert, &n_ids, &n_edge);
+    }
+    else {
+        if(OP_WLOAD != (uint8_t)msg[2] && OP_WSOLVE != (uint8_t)msg[2]) return -1;
+        if(len < MSG_EXT_SZ + MSG_WHDR_SZ) return -1;
+        memcpy(hdr, msg + MSG_EXT_SZ, sizeof(hdr));
+        if(hdr[2] > WIDE_EDGE_MAX
+        || MSG_EXT_SZ + MSG_WHDR_SZ + (long)hdr[2] * MSG_WREC_SZ > len) return -1;
+        b->rec = NULL;
+        b->n_rec = hdr[2];
+        b->wrec = malloc((size_t)b->n_rec * MSG_WREC_SZ + 1);
+        if(!b->wrec) return -1;
+        memcpy(b->wrec, msg + MSG_EXT_SZ + MSG_WHDR_SZ, (size_t)b->n_rec * MSG_WREC_SZ);
+        wcsr_count(b->wrec, b->n_rec, &n_vert, &n_ids, &n_edge);
+        if(n_ids > WIDE_ID_MAX) return -1;
+    }
+    b->n_ids = n_ids;
+    return n_ids > 1 ? 0 : -1;
+}
+
+// Draws the start & end of every query uniformly from ids 1 .. n_ids-1
+void bench_pairs( bench_t *b
+                , uint64_t seed
+                )
+{
+    uint32_t i = 0;
+
+    for(i = 0; i < 2 * b->n_pairs; ++i) {
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        b->pairs[i] = 1 + (seed * 0x2545f4914f6cdd1dull >> 32) % (b->n_ids - 1);
+    }
+}
+
+/* Time the parse, build and teardown of one layout
+ *
+ * Guarantees:
+ *   - parse is the csr_count() sizing pass every build starts with, build
+ *     the whole build into a new graph (build_csr or wbuild_csr) and
+ *     teardown freeing it; each is averaged over the reps
+ *   - The graph of the last rep is left built in g or wg
+ *   - 0 will be returned on success
+ *   - -1 will be returned if a build fails
+ */
+int bench_build( const bench_t *b
+               , graph_t *g
+               , wgraph_t *wg
+               )
+{
+    double t_parse = 0, t_build = 0, t_free = 0, t = 0;
+    uint64_t n_vert = 0, n_ids = 0;
+    uint32_t n_edge = 0;
+    int r = 0;
+
+    for(r = 0; r < b->reps; ++r) {
+        t = now();
+        if(g) csr_count(b->rec, b->n_rec, &n_vert, &n_ids, &n_edge);
+        else wcsr_count(b->wrec, b->n_rec, &n_vert, &n_ids, &n_edge);
+        t_parse += now() - t;
+        t = now();
+        if(g && 0 != build_csr(g, (const uint16_t *)b->rec, b->n_rec)) return -1;
+        if(!g && 0 != wbuild_csr(wg, b->wrec, b->n_rec, NULL)) return -1;
+        t_build += now() - t;
+        if(r + 1 == b->reps) break;
+        t = now();
+        if(g) free(g->off);
+        else free(wg->off);
+        t_free += now() - t;
+        if(g) memset(g, 0, sizeof(*g));
+        else memset(wg, 0, sizeof(*wg));
+    }
+    printf("  %-7s parse %9.1f us  build %9.1f us  teardown %7.1f us\n"
+           , g ? "compact" : "wide"
+           , t_parse * 1e6 / b->reps
+           , t_build * 1e6 / b->reps
+           , b->reps > 1 ? t_free * 1e6 / (b->reps - 1) : 0
+           );
+    return 0;
+}
+
+/* Time the queries on one layout and queue engine
+ *
+ * Requires:
+ *   - The graph built by bench_build (g compact, or wg wide)
+ *   - Scratch space initialized with the engine's arity & queue
+ *
+ * Guarantees:
+ *   - search is the kernel alone (dijkstras, dials or wcsr_dijkstras) and
+ *     serialise the text reply of its path (gen_path or wgen_path), both
+ *     per query
+ *   - The sum of the distances found is printed, so the engines and
+ *     layouts can be checked against each other
+ *   - 0 will be returned on success
+ *   - -1 will be returned on allocation failure
+ */
+int bench_search( const bench_t *b
+                , const char *name
+                , scratch_t *w
+                , const graph_t *g
+                , const wgraph_t *wg
+                )
+{
+    double t_search = 0, t_path = 0, t = 0;
+    uint64_t sum = 0;
+    uint32_t i = 0, n = b->n_pairs;
+
+    if(!g && 0 != scratch_wide(w, wg->n_ids)) return -1;
+    for(i = 0; i < n; ++i) {
+        uint32_t s = b->pairs[2*i], e = b->pairs[2*i+1];
+        scratch_next_epoch(w);
+        t = now();
+        if(!g) {
+            sum += wcsr_dijkstras( wg->n_vert, wg->off, wg->dest, wg->cost
+                                 , w->wv, &w->wh, w->epoch, s, e);
+        }
+        else if(QUEUE_BUCKET == w->queue) sum += dials(g, w, s, e);
+        else sum += dijkstras(g, w, s, e);
+        t_search += now() - t;
+        t = now();
+        if(g) gen_path(w, NULL, s, e);
+        else wgen_path(w, s, e);
+        t_path += now() - t;
+    }
+    printf("  %-7s %-6s search %9.2f us  serialise %6.2f us  (sum %llu)\n"
+           , g ? "compact" : "wide"
+           , name
+           , t_search * 1e6 / n
+           , t_path * 1e6 / n
+           , (unsigned long long)sum
+           );
+    return 0;
+}
+
+/* Benchmark one map file
+ *
+ * Guarantees:
+ *   - Builds and queries are timed on the compact layout, with every queue
+ *     engine, and on the wide layout; wide maps only have the latter
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int bench_file( const char *path
+              , int reps
+              , uint32_t n_pairs
+              , uint64_t seed
+              )
+{
+    bench_t b;
+    graph_t g;
+    wgraph_t wg;
+    scratch_t w;
+    char *msg = NULL;
+    long len = 0;
+    uint32_t e = 0;
+    int rc = -1;
+
+    memset(&b, 0, sizeof(b));
+    memset(&g, 0, sizeof(g));
+    memset(&wg, 0, sizeof(wg));
+    memset(&w, 0, sizeof(w));
+    if((len = read_file(path, &msg)) <= 0 || 0 != bench_map(&b, msg, len)) {
+        fprintf(stderr, "Map Error: %s\n", path);
+        free(b.wrec);
+        free(msg);
+        return -1;
+    }
+    b.reps = reps;
+    b.n_pairs = n_pairs;
+    b.pairs = malloc(sizeof(*b.pairs) * 2 * n_pairs);
+    if(!b.pairs) goto cleanup;
+    bench_pairs(&b, seed);
+    printf("%s: %u ids, %u edges, %u queries\n", path, b.n_ids - 1, b.n_rec, n_pairs);
+
+    if(b.rec) {
+        if(0 != bench_build(&b, &g, NULL)) goto cleanup;
+        for(e = 0; e < N_ENGINES; ++e) {
+            if(0 != scratch_init(&w, engines[e].arity, engines[e].queue)
+            || 0 != bench_search(&b, engines[e].name, &w, &g, NULL)) goto cleanup;
+            scratch_destroy(&w);
+        }
+    }
+    if(0 != bench_build(&b, NULL, &wg)
+    || 0 != scratch_init(&w, 2, QUEUE_HEAP)
+    || 0 != bench_search(&b, "heap2", &w, NULL, &wg)) goto cleanup;
+    rc = 0;
+cleanup:
+    if(0 != rc) fprintf(stderr, "Benchmark Error: %s\n", strerror(errno));
+    scratch_destroy(&w);
+    free(g.off);
+    free(wg.off);
+    free(b.wrec);
+    free(b.pairs);
+    free(msg);
+    return rc;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-r reps] [-n queries] [-s seed] [-x] map...\n"
+                    "  map         a problem, or a wide upload (OP_WLOAD) "
+                    "such as\n"
+                    "              dijkstra-server-input-gen -G writes\n"
+                    "  -r reps     builds timed per layout (default 10)\n"
+                    "  -n queries  random queries timed per layout and "
+                    "queue engine\n"
+                    "              (default 1000)\n"
+                    "  -s seed     seed of the queries (default 1)\n"
+                    "  -x          scalar relaxations: don't pick a SIMD "
+                    "kernel\n"
+                    , prog
+                    );
+}
+
+int main( int argc
+        , char *argv[]
+        )
+{
+    int opt = 0, reps = 10, n_pairs = 1000, scalar = 0, rc = 0;
+    uint64_t seed = 1;
+
+    while(-1 != (opt = getopt(argc, argv, "n:r:s:xh"))) {
+        switch(opt) {
+            case 'n': n_pairs = atoi(optarg); break;
+            case 'r': reps = atoi(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'x': scalar = 1; break;
+            default: usage(argv[0]); return 'h' == opt ? 0 : 1;
+        }
+    }
+    if(optind >= argc || reps < 1 || n_pairs < 1 || 0 == seed) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(!scalar) relax_init();
+    for(; optind < argc; ++optind) {
+        if(0 != bench_file(argv[optind], reps, n_pairs, seed)) rc = 1;
+    }
+    return rc;
+}
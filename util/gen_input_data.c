@@ -24,8 +24,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
-int main(void)
+#include "../src/graph_file.h"
+#include "../src/solver.h"
+
+#define MSG_EXT_SZ 4 // 0, opcode & flags
+#define OP_WLOAD 5 // extended request of a wide upload (see src/main.c)
+#define GEN_GRID_REACH 4 // rows & columns a grid shortcut may span
+
+// Writes the fixed example map
+int gen_example(const char *out)
 {
     uint16_t buffer[] = { 1, 5, 9 // start, end, # edges that follow
                         , 1, 2, 14
@@ -39,8 +49,9 @@ int main(void)
                         , 6, 5, 6
                         };
 
-    FILE *f = fopen("../data/map.bin", "w");
+    FILE *f = fopen(out, "w");
     int i = 0;
+    if(!f) return -1;
     for(; i < sizeof(buffer) / sizeof(*buffer); ++i) {
         fwrite(buffer+i, sizeof(*buffer), 1, f);
     }
@@ -48,3 +59,473 @@ int main(void)
 
     return 0;
 }
+
+// Writes len bytes of buf (or zeros if buf is NULL) then pads to alignment
+int put_sect( FILE *f
+            , const void *buf
+            , size_t len
+            )
+{
+    static const char zero[GRAPH_FILE_ALIGN] = {0};
+    size_t pad = (GRAPH_FILE_ALIGN - len % GRAPH_FILE_ALIGN) % GRAPH_FILE_ALIGN;
+    if(len && 1 != fwrite(buf, len, 1, f)) return -1;
+    if(pad && 1 != fwrite(zero, pad, 1, f)) return -1;
+    return 0;
+}
+
+// Returns the section size rounded up to the file alignment
+uint64_t aligned(uint64_t len)
+{
+    return (len + GRAPH_FILE_ALIGN - 1) / GRAPH_FILE_ALIGN * GRAPH_FILE_ALIGN;
+}
+
+/* Converts a map message (start, end, count, 6-byte edges) to a graph file
+ *
+ * Guarantees:
+ *   - The edges are laid out in CSR order by the server's build_csr (record
+ *     order is kept per vertex; records naming vertex 0 are dropped); see
+ *     src/graph_file.h for the layout
+ *   - The reverse adjacency is written too, as built by the server's
+ *     build_rev, so bidirectional searches need no build
+ *   - The contraction hierarchy is built and written too if with_ch is set
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int convert( const char *in
+           , const char *out
+           , int with_ch
+           )
+{
+    int rc = -1;
+    FILE *f = fopen(in, "r");
+    uint16_t hdr[3] = {0}, *rec = NULL;
+    uint32_t i = 0;
+    graph_t g;
+    graph_file_hdr_t fh;
+    graph_file_sect_t sect[11];
+    const void *data[11];
+    ch_t ch;
+    uint64_t pos = 0;
+
+    memset(&g, 0, sizeof(g));
+    memset(&ch, 0, sizeof(ch));
+
+    if(!f) return -1;
+    if(1 != fread(hdr, sizeof(hdr), 1, f)) goto cleanup;
+    rec = malloc((size_t)hdr[2] * MSG_REC_SZ + 1);
+    if(!rec) goto cleanup;
+    if(hdr[2] != fread(rec, MSG_REC_SZ, hdr[2], f)) goto cleanup;
+    fclose(f);
+    f = NULL;
+    if(0 != build_csr(&g, rec, hdr[2]) || 0 != build_rev(&g)) goto cleanup;
+
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, GRAPH_FILE_MAGIC, sizeof(fh.magic));
+    fh.version = GRAPH_FILE_VERSION;
+    fh.n_vert = g.n_vert;
+    fh.n_edge = g.n_edge;
+    fh.n_sect = 6;
+    if(with_ch) {
+        if(0 != ch_build(&ch, g.n_vert, g.off, g.dest, g.cost)) goto cleanup;
+        fh.n_sect = 11;
+    }
+    memset(sect, 0, sizeof(sect));
+    pos = aligned(sizeof(fh) + sizeof(*sect) * fh.n_sect);
+    sect[0].type = SECT_OFF;
+    sect[0].width = sizeof(*g.off);
+    sect[0].size = sizeof(*g.off) * ((uint64_t)g.n_vert + 1);
+    sect[1].type = SECT_DEST;
+    sect[1].width = sizeof(*g.dest);
+    sect[1].size = sizeof(*g.dest) * (uint64_t)g.n_edge;
+    sect[2].type = SECT_COST;
+    sect[2].width = sizeof(*g.cost);
+    sect[2].size = sizeof(*g.cost) * (uint64_t)g.n_edge;
+    sect[3].type = SECT_ROFF;
+    sect[3].width = sizeof(*g.roff);
+    sect[3].size = sizeof(*g.roff) * ((uint64_t)g.rn_vert + 1);
+    sect[4].type = SECT_RSRC;
+    sect[4].width = sizeof(*g.rsrc);
+    sect[4].size = sizeof(*g.rsrc) * (uint64_t)g.n_edge;
+    sect[5].type = SECT_RCOST;
+    sect[5].width = sizeof(*g.rcost);
+    sect[5].size = sizeof(*g.rcost) * (uint64_t)g.n_edge;
+    sect[6].type = SECT_CH_RANK;
+    sect[6].width = sizeof(*ch.rank);
+    sect[6].size = sizeof(*ch.rank) * (uint64_t)ch.n_vert;
+    sect[7].type = SECT_CH_UOFF;
+    sect[7].width = sizeof(*ch.uoff);
+    sect[7].size = sizeof(*ch.uoff) * ((uint64_t)ch.n_vert + 1);
+    sect[8].type = SECT_CH_UP;
+    sect[8].width = sizeof(*ch.up);
+    sect[8].size = sizeof(*ch.up) * (uint64_t)ch.n_up;
+    sect[9].type = SECT_CH_DOFF;
+    sect[9].width = sizeof(*ch.doff);
+    sect[9].size = sizeof(*ch.doff) * ((uint64_t)ch.n_vert + 1);
+    sect[10].type = SECT_CH_DN;
+    sect[10].width = sizeof(*ch.dn);
+    sect[10].size = sizeof(*ch.dn) * (uint64_t)ch.n_dn;
+    data[0] = g.off;
+    data[1] = g.dest;
+    data[2] = g.cost;
+    data[3] = g.roff;
+    data[4] = g.rsrc;
+    data[5] = g.rcost;
+    data[6] = ch.rank;
+    data[7] = ch.uoff;
+    data[8] = ch.up;
+    data[9] = ch.doff;
+    data[10] = ch.dn;
+    for(i = 0; i < fh.n_sect; ++i) {
+        sect[i].off = pos;
+        pos += aligned(sect[i].size);
+    }
+
+    f = fopen(out, "w");
+    if(!f) goto cleanup;
+    if(0 != put_sect(f, &fh, sizeof(fh))
+    || 0 != put_sect(f, sect, sizeof(*sect) * fh.n_sect)) goto cleanup;
+    for(i = 0; i < fh.n_sect; ++i) {
+        if(0 != put_sect(f, data[i], sect[i].size)) goto cleanup;
+    }
+    rc = 0;
+cleanup:
+    if(f && 0 != fclose(f)) rc = -1;
+    free(rec);
+    free(g.off);
+    free(g.roff);
+    ch_free(&ch);
+    return rc;
+}
+
+/* Converts a wide map message (an OP_WLOAD or OP_WSOLVE: extended header,
+ * 4-byte start, end & count, 12-byte edges) to a wide graph file
+ *
+ * Guarantees:
+ *   - The edges are laid out in CSR order by the server's wbuild_csr, in
+ *     4-byte sections; see src/graph_file.h
+ *   - Only the forward graph is written; wide graphs are searched one way
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int convert_wide( const char *in
+                , const char *out
+                )
+{
+    int rc = -1;
+    FILE *f = fopen(in, "r");
+    uint32_t hdr[3] = {0}, i = 0;
+    char ext[MSG_EXT_SZ], *rec = NULL;
+    wgraph_t g;
+    graph_file_hdr_t fh;
+    graph_file_sect_t sect[3];
+    const void *data[3];
+    uint64_t pos = 0;
+
+    memset(&g, 0, sizeof(g));
+
+    if(!f) return -1;
+    if(1 != fread(ext, sizeof(ext), 1, f)
+    || 1 != fread(hdr, sizeof(hdr), 1, f)) goto cleanup;
+    rec = malloc((size_t)hdr[2] * MSG_WREC_SZ + 1);
+    if(!rec) goto cleanup;
+    if(hdr[2] != fread(rec, MSG_WREC_SZ, hdr[2], f)) goto cleanup;
+    fclose(f);
+    f = NULL;
+    if(0 != wbuild_csr(&g, rec, hdr[2], NULL)) goto cleanup;
+
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, GRAPH_FILE_MAGIC, sizeof(fh.magic));
+    fh.version = GRAPH_FILE_VERSION;
+    fh.n_vert = g.n_vert;
+    fh.n_edge = g.n_edge;
+    fh.n_sect = 3;
+    memset(sect, 0, sizeof(sect));
+    pos = aligned(sizeof(fh) + sizeof(*sect) * fh.n_sect);
+    sect[0].type = SECT_OFF;
+    sect[0].width = sizeof(*g.off);
+    sect[0].size = sizeof(*g.off) * ((uint64_t)g.n_vert + 1);
+    sect[1].type = SECT_DEST;
+    sect[1].width = sizeof(*g.dest);
+    sect[1].size = sizeof(*g.dest) * (uint64_t)g.n_edge;
+    sect[2].type = SECT_COST;
+    sect[2].width = sizeof(*g.cost);
+    sect[2].size = sizeof(*g.cost) * (uint64_t)g.n_edge;
+    data[0] = g.off;
+    data[1] = g.dest;
+    data[2] = g.cost;
+    for(i = 0; i < fh.n_sect; ++i) {
+        sect[i].off = pos;
+        pos += aligned(sect[i].size);
+    }
+
+    f = fopen(out, "w");
+    if(!f) goto cleanup;
+    if(0 != put_sect(f, &fh, sizeof(fh))
+    || 0 != put_sect(f, sect, sizeof(*sect) * fh.n_sect)) goto cleanup;
+    for(i = 0; i < fh.n_sect; ++i) {
+        if(0 != put_sect(f, data[i], sect[i].size)) goto cleanup;
+    }
+    rc = 0;
+cleanup:
+    if(f && 0 != fclose(f)) rc = -1;
+    free(rec);
+    free(g.off);
+    return rc;
+}
+
+// Families of generated graphs
+enum {
+    GEN_RANDOM = 0, // edges between uniformly random vertices
+    GEN_GRID = 1,   // road-like: a 2-way lattice plus short local shortcuts
+    GEN_POWER = 2   // power-law degrees by preferential attachment (2-way)
+};
+
+// Edges streamed to a generated map; costs are uniform in cmin..cmax
+typedef struct {
+    FILE *f;
+    int wide;       // 4-byte records of a wide problem
+    uint32_t n;     // edges written
+    uint32_t max;   // edges wanted
+    uint32_t cmin;
+    uint32_t cmax;
+    uint64_t rng;   // xorshift64* state; never 0
+} gen_t;
+
+// Returns the next pseudo-random number of the generator
+uint64_t gen_rand(gen_t *g)
+{
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 2685821657736338717ull;
+}
+
+// Returns a pseudo-random number in 0 .. n-1
+uint32_t gen_below( gen_t *g
+                  , uint32_t n
+                  )
+{
+    return gen_rand(g) % n;
+}
+
+// Writes the edge a->b with a random cost unless max edges are written;
+// returns 0 or -1
+int gen_edge( gen_t *g
+            , uint32_t a
+            , uint32_t b
+            )
+{
+    uint32_t c = g->cmin + gen_below(g, g->cmax - g->cmin + 1);
+    uint16_t rec[3] = { a, b, c };
+    uint32_t wrec[3] = { a, b, c };
+
+    if(g->n >= g->max) return 0;
+    ++g->n;
+    if(g->wide) return 1 == fwrite(wrec, sizeof(wrec), 1, g->f) ? 0 : -1;
+    return 1 == fwrite(rec, sizeof(rec), 1, g->f) ? 0 : -1;
+}
+
+/* Writes a generated map
+ *
+ * Requires:
+ *   - A family of graphs (GEN_*), n_vert >= 2 vertices (ids 1 .. n_vert)
+ *     and n_edge edges, within the limits of the map format
+ *   - The range of the edge costs and a seed
+ *   - Whether to write a wide upload (OP_WLOAD) rather than a problem; it
+ *     is written anyway if ids, the count or costs don't fit in 2 bytes
+ *
+ * Guarantees:
+ *   - The same arguments write the same file
+ *   - Every family has exactly n_edge edges; the start & end are random
+ *   - GEN_GRID lays the vertices out row by row on a square lattice with
+ *     edges both ways between neighbours (about 4 per vertex), then fills
+ *     up with edges to vertices up to GEN_GRID_REACH rows & columns away
+ *   - GEN_POWER joins each vertex both ways to n_edge / (2 n_vert) earlier
+ *     ones picked in proportion to their degree, then fills up with edges
+ *     between endpoints picked the same way
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int gen_graph( const char *out
+             , int kind
+             , uint32_t n_vert
+             , uint32_t n_edge
+             , uint32_t cmin
+             , uint32_t cmax
+             , uint64_t seed
+             , int wide
+             )
+{
+    int rc = -1;
+    gen_t g = { NULL, 0, 0, n_edge, cmin, cmax, seed | 1 };
+    uint32_t hdr[3] = {0}, v = 0, u = 0, side = 1, *ends = NULL, n_ends = 0;
+    uint16_t shdr[3] = {0};
+    char ext[MSG_EXT_SZ] = { 0, 0, OP_WLOAD, 0 };
+
+    g.wide = wide || n_vert > UINT16_MAX || n_edge > UINT16_MAX
+          || cmax > UINT16_MAX;
+    if(!(g.f = fopen(out, "w"))) return -1;
+    hdr[0] = 1 + gen_below(&g, n_vert);
+    hdr[1] = 1 + gen_below(&g, n_vert);
+    hdr[2] = n_edge;
+    shdr[0] = hdr[0];
+    shdr[1] = hdr[1];
+    shdr[2] = hdr[2];
+    if(g.wide && 1 != fwrite(ext, sizeof(ext), 1, g.f)) goto cleanup;
+    if(g.wide ? 1 != fwrite(hdr, sizeof(hdr), 1, g.f)
+            : 1 != fwrite(shdr, sizeof(shdr), 1, g.f)) goto cleanup;
+
+    switch(kind) {
+        case GEN_GRID:
+            while((uint64_t)side * side < n_vert) ++side;
+            for(v = 1; v <= n_vert && g.n < g.max; ++v) {
+                if(v % side != 0 && v + 1 <= n_vert) { // right neighbour
+                    if(0 != gen_edge(&g, v, v + 1)
+                    || 0 != gen_edge(&g, v + 1, v)) goto cleanup;
+                }
+                if((uint64_t)v + side <= n_vert) { // neighbour below
+                    if(0 != gen_edge(&g, v, v + side)
+                    || 0 != gen_edge(&g, v + side, v)) goto cleanup;
+                }
+            }
+            while(g.n < g.max) { // shortcuts near the source
+                int64_t dr = (int64_t)gen_below(&g, 2 * GEN_GRID_REACH + 1)
+                           - GEN_GRID_REACH;
+                int64_t dc = (int64_t)gen_below(&g, 2 * GEN_GRID_REACH + 1)
+                           - GEN_GRID_REACH;
+                int64_t w = 0;
+                v = 1 + gen_below(&g, n_vert);
+                w = (int64_t)v + dr * side + dc;
+                if(w < 1 || w > n_vert || w == v) continue;
+                if(0 != gen_edge(&g, v, w)) goto cleanup;
+            }
+            break;
+        case GEN_POWER: {
+            uint32_t per = n_edge / (2 * n_vert), j = 0;
+            ends = malloc(sizeof(*ends) * ((size_t)n_edge + 2));
+            if(!ends) goto cleanup;
+            if(0 == per) per = 1;
+            for(v = 2; v <= n_vert && g.n < g.max; ++v) {
+                for(j = 0; j < per && g.n < g.max; ++j) {
+                    u = 0 == n_ends ? 1 : ends[gen_below(&g, n_ends)];
+                    if(0 != gen_edge(&g, v, u) || 0 != gen_edge(&g, u, v)) {
+                        goto cleanup;
+                    }
+                    ends[n_ends++] = v;
+                    ends[n_ends++] = u;
+                }
+            }
+            while(g.n < g.max) {
+                v = ends[gen_below(&g, n_ends)];
+                u = ends[gen_below(&g, n_ends)];
+                if(u != v && 0 != gen_edge(&g, v, u)) goto cleanup;
+            }
+            break;
+        }
+        default:
+            while(g.n < g.max) {
+                v = 1 + gen_below(&g, n_vert);
+                u = 1 + gen_below(&g, n_vert);
+                if(u != v && 0 != gen_edge(&g, v, u)) goto cleanup;
+            }
+            break;
+    }
+    rc = 0;
+cleanup:
+    if(g.f && 0 != fclose(g.f)) rc = -1;
+    free(ends);
+    return rc;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-c map [-H | -W]] [-o file]\n"
+                    "       %s -G kind [-n vertices] [-m edges] [-r costs] "
+                    "[-s seed] [-W]\n"
+                    "          [-o file]\n"
+                    "  (no -c)  write the example map (default file "
+                    "../data/map.bin)\n"
+                    "  -c map   convert a map (start, end, count & edges) to a "
+                    "graph file\n"
+                    "           the server can mmap (default file "
+                    "../data/map.djkg)\n"
+                    "  -H       also write the graph's contraction hierarchy\n"
+                    "  -W       the map is a wide message (OP_WLOAD or "
+                    "OP_WSOLVE); write a\n"
+                    "           wide graph file. With -G: write a wide "
+                    "upload (also done\n"
+                    "           when the graph doesn't fit a problem)\n"
+                    "  -G kind  generate a map (default file "
+                    "../data/map.bin): random,\n"
+                    "           grid (road-like) or power (power-law "
+                    "degrees)\n"
+                    "  -n, -m   vertices (default 1000) & edges (default 4 "
+                    "per vertex)\n"
+                    "  -r costs edge cost range lo-hi (default 1-100)\n"
+                    "  -s seed  seed of the generator (default 1)\n"
+                    "  -o file  file to write\n"
+                    , prog
+                    , prog
+                    );
+}
+
+int main( int argc
+        , char *argv[]
+        )
+{
+    const char *in = NULL, *out = NULL;
+    int opt = 0, with_ch = 0, wide = 0, rc = 0, kind = -1;
+    unsigned long n_vert = 1000, n_edge = 0, cmin = 1, cmax = 100;
+    unsigned long long seed = 1;
+
+    while(-1 != (opt = getopt(argc, argv, "c:G:HWm:n:o:r:s:h"))) {
+        switch(opt) {
+            case 'c': in = optarg; break;
+            case 'G':
+                if(0 == strcmp(optarg, "random")) kind = GEN_RANDOM;
+                else if(0 == strcmp(optarg, "grid")) kind = GEN_GRID;
+                else if(0 == strcmp(optarg, "power")) kind = GEN_POWER;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'H': with_ch = 1; break;
+            case 'W': wide = 1; break;
+            case 'm': n_edge = strtoul(optarg, NULL, 0); break;
+            case 'n': n_vert = strtoul(optarg, NULL, 0); break;
+            case 'o': out = optarg; break;
+            case 'r':
+                if(2 != sscanf(optarg, "%lu-%lu", &cmin, &cmax)) cmin = 0;
+                break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            default: usage(argv[0]); return 'h' == opt ? 0 : 1;
+        }
+    }
+    if(kind >= 0) {
+        if(0 == n_edge) n_edge = 4 * n_vert;
+        if(n_vert < 2 || n_vert >= WIDE_ID_MAX || n_edge > WIDE_EDGE_MAX
+        || 0 == cmin || cmin > cmax || cmax > UINT32_MAX) {
+            usage(argv[0]);
+            return 1;
+        }
+        out = out ? out : "../data/map.bin";
+        if(0 == gen_graph(out, kind, n_vert, n_edge, cmin, cmax, seed, wide)) {
+            return 0;
+        }
+        fprintf(stderr, "Write Error: %s\n", out);
+        return 1;
+    }
+    if(in) {
+        out = out ? out : "../data/map.djkg";
+        rc = wide ? convert_wide(in, out) : convert(in, out, with_ch);
+        if(0 == rc) return 0;
+        fprintf(stderr, "Conversion Error: %s\n", in);
+        return 1;
+    }
+    if(0 != gen_example(out ? out : "../data/map.bin")) {
+        fprintf(stderr, "Write Error\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+/* Load Generator for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "tool.h"
+
+#define LISTEN_PORT 7777
+#define OP_HELLO 1 // extended requests of the server (see src/main.c)
+#define OP_QUERY 3
+#define SESSION_FRAMED 0x01
+#define REPLY_MAX (64u << 20) // largest framed reply accepted
+
+// Settings shared by every connection
+typedef struct {
+    struct sockaddr_in addr;
+    const char *msg;     // legacy mode: the map sent on each connection
+    size_t msg_len;
+    uint16_t graph;      // query mode: the resident graph queried
+    uint16_t n_vert;     // query mode: ids are drawn from 1 .. n_vert
+    uint8_t algo;        // query mode: flags of each OP_QUERY
+    double rate;         // requests per second per connection; 0: closed
+    double end;          // time to stop at
+    uint64_t max;        // requests per connection; 0 if unbounded
+} load_t;
+
+// One connection's requests and latencies
+typedef struct {
+    pthread_t tid;
+    const load_t *l;
+    uint64_t seed;
+    uint32_t *lat;       // microseconds of each request answered
+    uint64_t n;
+    uint64_t cap;
+    uint64_t errors;
+} conn_t;
+
+// Sleeps until the monotonic time t
+void sleep_until(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9);
+    while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+}
+
+// Writes or reads exactly len bytes; returns 0 or -1
+int xfer( int fd
+        , void *buf
+        , size_t len
+        , int out
+        )
+{
+    char *p = buf;
+    while(len > 0) {
+        ssize_t n = out ? write(fd, p, len) : read(fd, p, len);
+        if(n < 0 && EINTR == errno) continue;
+        if(n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Opens a connection to the server; returns the fd or -1
+int dial(const load_t *l)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+    if(-1 == fd) return -1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(0 != connect(fd, (const struct sockaddr *)&l->addr, sizeof(l->addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Sends one request and waits for its reply
+ *
+ * Guarantees:
+ *   - Legacy mode: the map is sent on a new connection and the reply is
+ *     read until the server closes it
+ *   - Query mode: a random OP_QUERY is sent on the framed session *fd,
+ *     which is opened first if it is -1 and closed on error
+ *   - 0 will be returned on success
+ *   - -1 will be returned on error
+ */
+int request( conn_t *c
+           , int *fd
+           , char **buf
+           , size_t *cap
+           )
+{
+    const load_t *l = c->l;
+    uint16_t q[5] = { 0, 0, l->graph, 0, 0 };
+    uint32_t len = 0;
+
+    if(l->msg) {
+        char tmp[4096];
+        ssize_t n = 0;
+        int s = dial(l);
+        if(-1 == s) return -1;
+        if(0 != xfer(s, (void *)l->msg, l->msg_len, 1)) n = -1;
+        while(n >= 0 && (n = read(s, tmp, sizeof(tmp))) > 0);
+        close(s);
+        return n < 0 ? -1 : 0;
+    }
+    if(-1 == *fd) {
+        char hello[4] = { 0, 0, OP_HELLO, SESSION_FRAMED };
+        if(-1 == (*fd = dial(l))) return -1;
+        if(0 != xfer(*fd, hello, sizeof(hello), 1)) goto error;
+    }
+    memcpy(q, (char[]){ 0, 0, OP_QUERY, l->algo }, 4);
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 7;
+    c->seed ^= c->seed << 17;
+    q[3] = 1 + c->seed % l->n_vert;
+    q[4] = 1 + (c->seed >> 32) % l->n_vert;
+    if(0 != xfer(*fd, q, sizeof(q), 1)
+    || 0 != xfer(*fd, &len, sizeof(len), 0) || len > REPLY_MAX) goto error;
+    if(len > *cap) {
+        char *p = realloc(*buf, len);
+        if(!p) goto error;
+        *buf = p;
+        *cap = len;
+    }
+    if(0 != xfer(*fd, *buf, len, 0)) goto error;
+    return 0;
+error:
+    close(*fd);
+    *fd = -1;
+    return -1;
+}
+
+/* Runs the requests of one connection
+ *
+ * Guarantees:
+ *   - Closed loop (rate 0): the next request is sent when the reply to the
+ *     last one arrives
+ *   - Open loop: requests are due every 1/rate seconds; the latency of a
+ *     late one counts from when it was due, so a stalled server isn't
+ *     hidden by the client waiting on it
+ */
+void * conn_main(void *arg)
+{
+    conn_t *c = arg;
+    const load_t *l = c->l;
+    char *buf = NULL;
+    size_t cap = 0;
+    int fd = -1;
+    double due = now();
+
+    while((0 == l->max || c->n + c->errors < l->max)) {
+        double t = 0;
+        if(l->rate > 0) sleep_until(due);
+        else due = now();
+        if(due >= l->end) break;
+        if(0 != request(c, &fd, &buf, &cap)) ++c->errors;
+        else {
+            if(c->n == c->cap) {
+                uint64_t n = c->cap ? c->cap * 2 : 4096;
+                uint32_t *p = realloc(c->lat, sizeof(*p) * n);
+                if(!p) break;
+                c->lat = p;
+                c->cap = n;
+            }
+            t = (now() - due) * 1e6;
+            c->lat[c->n++] = t > UINT32_MAX ? UINT32_MAX : (uint32_t)t;
+        }
+        if(l->rate > 0) due += 1 / l->rate;
+    }
+    if(-1 != fd) close(fd);
+    free(buf);
+    return NULL;
+}
+
+int cmp_u32( const void *a
+           , const void *b
+           )
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Returns the latency at quantile q of n sorted samples
+uint32_t quantile( const uint32_t *lat
+                 , uint64_t n
+                 , double q
+                 )
+{
+    uint64_t i = (uint64_t)(q * n);
+    if(0 == n) return 0;
+    return lat[i < n ? i : n - 1];
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s (-f map | -g graph -n vertices [-a algo]) "
+                    "[-c conns]\n"
+                    "       [-d seconds] [-N requests] [-R rate] "
+                    "[-H host] [-p port]\n"
+                    "  -f map       send the map (a problem or any message) "
+                    "on a new\n"
+                    "               connection per request, as legacy "
+                    "clients do\n"
+                    "  -g graph     query the resident graph in framed "
+                    "sessions instead,\n"
+                    "  -n vertices  from & to random ids 1 .. vertices\n"
+                    "  -a algo      OP_QUERY algorithm flags (default 0)\n"
+                    "  -c conns     concurrent connections (default 16)\n"
+                    "  -d seconds   how long to run (default 10)\n"
+                    "  -N requests  stop after this many requests (default: "
+                    "no limit)\n"
+                    "  -R rate      open loop: requests per second over all "
+                    "connections;\n"
+                    "               0 sends each request on a reply "
+                    "(default 0)\n"
+                    "  -H host      server address (default 127.0.0.1)\n"
+                    "  -p port      server port (default %d)\n"
+                    , prog
+                    , LISTEN_PORT
+                    );
+}
+
+int main( int argc
+        , char *argv[]
+        )
+{
+    load_t l;
+    conn_t *c = NULL;
+    uint32_t *lat = NULL;
+    uint64_t n = 0, errors = 0, max = 0;
+    int opt = 0, i = 0, conns = 16, port = LISTEN_PORT, n_vert = 0, graph = 0;
+    double seconds = 10, rate = 0, t0 = 0, t = 0;
+    const char *host = "127.0.0.1";
+    char *msg = NULL;
+    long len = 0;
+
+    memset(&l, 0, sizeof(l));
+    while(-1 != (opt = getopt(argc, argv, "a:c:d:f:g:H:n:N:p:R:h"))) {
+        switch(opt) {
+            case 'a': l.algo = atoi(optarg); break;
+            case 'c': conns = atoi(optarg); break;
+            case 'd': seconds = atof(optarg); break;
+            case 'f':
+                if((len = read_file(optarg, &msg)) <= 0) {
+                    fprintf(stderr, "Map Error: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g': graph = atoi(optarg); break;
+            case 'H': host = optarg; break;
+            case 'n': n_vert = atoi(optarg); break;
+            case 'N': max = strtoull(optarg, NULL, 0); break;
+            case 'p': port = atoi(optarg); break;
+            case 'R': rate = atof(optarg); break;
+            default: usage(argv[0]); return 'h' == opt ? 0 : 1;
+        }
+    }
+    if((!msg && (graph < 1 || graph > 65535 || n_vert < 1 || n_vert > 65535))
+    || conns < 1 || seconds <= 0 || rate < 0 || port < 1 || port > 65535) {
+        usage(argv[0]);
+        return 1;
+    }
+    l.addr.sin_family = AF_INET;
+    l.addr.sin_port = htons(port);
+    if(1 != inet_pton(AF_INET, host, &l.addr.sin_addr)) {
+        fprintf(stderr, "Address Error: %s\n", host);
+        return 1;
+    }
+    l.msg = msg;
+    l.msg_len = len;
+    l.graph = graph;
+    l.n_vert = n_vert;
+    l.rate = rate / conns;
+    l.max = max ? (max + conns - 1) / conns : 0;
+
+    c = calloc(conns, sizeof(*c));
+    if(!c) {
+        fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+        return 1;
+    }
+    t0 = now();
+    l.end = t0 + seconds;
+    for(i = 0; i < conns; ++i) {
+        c[i].l = &l;
+        c[i].seed = 0x9e3779b97f4a7c15ull * (i + 1);
+        errno = pthread_create(&c[i].tid, NULL, conn_main, &c[i]);
+        if(0 != errno) {
+            fprintf(stderr, "Thread Error: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    for(i = 0; i < conns; ++i) {
+        pthread_join(c[i].tid, NULL);
+        n += c[i].n;
+        errors += c[i].errors;
+    }
+    t = now() - t0;
+    lat = malloc(sizeof(*lat) * (n ? n : 1));
+    if(!lat) {
+        fprintf(stderr, "Allocation Error: %s\n", strerror(errno));
+        return 1;
+    }
+    for(i = 0, n = 0; i < conns; ++i) {
+        memcpy(lat + n, c[i].lat, sizeof(*lat) * c[i].n);
+        n += c[i].n;
+        free(c[i].lat);
+    }
+    qsort(lat, n, sizeof(*lat), cmp_u32);
+    printf("requests %llu\n"
+           "errors %llu\n"
+           "seconds %.2f\n"
+           "throughput %.1f req/s\n"
+           "latency_us p50 %u p99 %u p999 %u max %u\n"
+           , (unsigned long long)n
+           , (unsigned long long)errors
+           , t
+           , n / t
+           , quantile(lat, n, 0.5)
+           , quantile(lat, n, 0.99)
+           , quantile(lat, n, 0.999)
+           , n ? lat[n-1] : 0
+           );
+    free(lat);
+    free(c);
+    free(msg);
+    return 0;
+}
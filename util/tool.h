@@ -0,0 +1,58 @@
+/* Tool Helpers for Dijkstra Server Reference Solution
+ *
+ * Copyright (c) 2013 Jesse J. Cook
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef TOOL_H
+#define TOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Helpers shared by the load client (load_client.c) and the solver
+// benchmark (bench.c)
+
+// Returns the monotonic time in seconds
+static inline double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Reads the whole file into *msg; returns its length or -1
+static inline long read_file( const char *path
+                            , char **msg
+                            )
+{
+    FILE *f = fopen(path, "r");
+    long len = -1;
+
+    if(!f) return -1;
+    if(0 == fseek(f, 0, SEEK_END) && (len = ftell(f)) > 0
+    && 0 == fseek(f, 0, SEEK_SET) && (*msg = malloc(len))
+    && 1 != fread(*msg, len, 1, f)) len = -1;
+    fclose(f);
+    return len;
+}
+
+#endif // TOOL_H